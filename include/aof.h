@@ -27,6 +27,10 @@ public:
     using ReplayCallback = std::function<void(Command, const std::string&, const std::string&)>;
     void replay(ReplayCallback callback);
 
+    // Every encoded frame passed to log() is also handed to the tap (used to feed replicas)
+    using Tap = std::function<void(const std::vector<uint8_t>&)>;
+    void setTap(Tap tap);
+
 private:
     std::string filename_;
     int interval_ms_;
@@ -36,6 +40,7 @@ private:
     std::mutex queue_mutex_;
     std::condition_variable queue_cv_;
     std::queue<std::vector<uint8_t>> queue_;
+    Tap tap_;
 
     void flushLoop();
 };
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace kvcache {
+
+// Source of truth behind the cache, read through on misses. load() returns std::nullopt for
+// a key the backend does not have and throws when the backend cannot answer.
+// Implementations are called from many threads at once.
+class Backend {
+public:
+    virtual ~Backend() = default;
+
+    virtual std::optional<std::string> load(const std::string& key) = 0;
+
+    // One result per key, in order. Override when the backend can fetch several keys in one
+    // round trip; the default loads them one by one.
+    virtual std::vector<std::optional<std::string>> loadMany(const std::vector<std::string>& keys);
+};
+
+// Serves each key from the file of the same name in a directory. Keys that are not plain
+// file names (empty, ".", "..", or containing '/') are never found.
+class DirectoryBackend : public Backend {
+public:
+    explicit DirectoryBackend(const std::string& dir);
+
+    std::optional<std::string> load(const std::string& key) override;
+
+private:
+    std::string dir_;
+};
+
+}  // namespace kvcache
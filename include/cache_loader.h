@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "cache_policies.h"
+#include "lru_cache.h"
+#include "thread_pool.h"
+
+namespace kvcache {
+
+// Read-through loading for a ShardedCache: on a miss exactly one caller runs the loader
+// and every concurrent caller for the same key waits on its result (single flight).
+//
+// Loaded entries are remembered with their version and load time, so they can expire after
+// ttl and be reloaded in the background once refresh_ahead of ttl has passed. An entry
+// written directly (put/update) gets a new version and is no longer subject to the ttl.
+// "Not found" is remembered for negative_ttl. The bookkeeping is bounded by max_records:
+// when the record of a loaded entry is dropped, so is the entry, which is then loaded
+// again on its next read instead of being served past its ttl.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class CacheLoader {
+public:
+    struct Options {
+        std::chrono::milliseconds ttl{0};              // Loaded entries expire after this; 0 never
+        std::chrono::milliseconds negative_ttl{1000};  // How long "not found" is cached; 0 disables
+        double refresh_ahead = 0;                      // Hits past this fraction of ttl reload in the
+                                                       // background; 0 disables
+        size_t max_records = 1 << 16;                  // Bound on remembered loads and misses
+        size_t threads = 2;                            // For async loads and refreshes
+    };
+
+    struct Stats {
+        std::atomic<uint64_t> loads{0};          // Keys handed to a loader
+        std::atomic<uint64_t> coalesced{0};      // Callers that waited on another caller's load
+        std::atomic<uint64_t> negative_hits{0};  // Misses answered by a cached "not found"
+        std::atomic<uint64_t> expired{0};
+        std::atomic<uint64_t> refreshes{0};
+    };
+
+    explicit CacheLoader(const Options& options = Options());
+
+    CacheLoader(const CacheLoader&) = delete;
+    CacheLoader& operator=(const CacheLoader&) = delete;
+
+    // loader() returns std::optional<Value> (std::nullopt: not found) or a std::future of
+    // one. A loader exception reaches every waiting caller and is not cached. With
+    // refresh_ahead the loader is copied and may run after the call returns.
+    template <typename Cache, typename Loader>
+    std::optional<Value> getOrLoad(Cache& cache, const Key& key, Loader&& loader);
+
+    // Like getOrLoad, but a miss is loaded on the loader's own threads
+    template <typename Cache, typename Loader>
+    std::shared_future<std::optional<Value>> getOrLoadAsync(Cache& cache, const Key& key, Loader loader);
+
+    // Answers hits from the cache and loads all remaining keys with one call to
+    // loader(const std::vector<Key>&), which returns (a future of) one std::optional<Value>
+    // per key, in order. Keys already being loaded by others are waited on instead.
+    template <typename Cache, typename BatchLoader>
+    std::vector<std::optional<Value>> getAllOrLoad(Cache& cache, const std::vector<Key>& keys,
+                                                   BatchLoader&& loader);
+
+    const Options& options() const {
+        return options_;
+    }
+    const Stats& stats() const {
+        return stats_;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    using Result = std::optional<Value>;
+
+    struct Flight {
+        std::promise<Result> promise;
+        std::shared_future<Result> future = promise.get_future().share();
+    };
+
+    // What the loader last said about a key
+    struct Record {
+        uint64_t version;  // Of the loaded entry; 0 for "not found"
+        Clock::time_point at;
+    };
+
+    // Keys one batch loader call is responsible for
+    struct Batch {
+        std::vector<Key> keys;
+        std::vector<std::shared_ptr<Flight>> flights;
+        std::vector<uint64_t> versions;
+        void add(const Key& key, std::shared_ptr<Flight> flight, uint64_t version) {
+            keys.push_back(key);
+            flights.push_back(std::move(flight));
+            versions.push_back(version);
+        }
+    };
+
+    static constexpr size_t kStripes = 16;
+    struct Stripe {
+        std::mutex mutex;
+        std::unordered_map<Key, std::shared_ptr<Flight>, Hash> flights;
+        std::unique_ptr<LRUCache<Key, Record, FifoEviction>> records;
+        std::vector<std::pair<Key, uint64_t>> dropped;  // Loaded entries whose records the last
+                                                        // put evicted; under the records' lock
+    };
+
+    Options options_;
+    Hash hash_;
+    std::array<Stripe, kStripes> stripes_;
+    Stats stats_;
+    ThreadPool pool_;  // Last: joined before the rest is torn down
+
+    Stripe& stripe(const Key& key) {
+        return stripes_[Murmur3Mixer::mix(hash_(key)) & (kStripes - 1)];
+    }
+
+    // Answers key from the cache or a cached "not found". Returns std::nullopt when it has
+    // to be loaded, with version set to that of the expired entry (0 if absent). Sets stale
+    // and version when a hit is due for refresh-ahead.
+    template <typename Cache>
+    std::optional<Result> lookup(Cache& cache, const Key& key, uint64_t& version, bool& stale);
+
+    // Returns the key's flight and whether the caller started it (and must run it)
+    std::pair<std::shared_ptr<Flight>, bool> join(const Key& key);
+
+    // Run the loader for a flight this caller leads; they never throw
+    template <typename Cache, typename Loader>
+    void run(Cache& cache, const Key& key, Flight& flight, uint64_t observed, Loader& loader);
+    template <typename Cache, typename BatchLoader>
+    void runBatch(Cache& cache, const Batch& batch, BatchLoader& loader);
+
+    // Stores the loaded result and completes the flight. observed is the version the load
+    // replaces (0 if none); a different version means the key was written meanwhile.
+    template <typename Cache>
+    void complete(Cache& cache, const Key& key, Flight& flight, uint64_t observed, const Result& loaded);
+    // Stores a record and drops the entries of the loaded records it evicts
+    template <typename Cache>
+    void remember(Cache& cache, Stripe& s, const Key& key, const Record& record);
+    void fail(const Key& key, Flight& flight, std::exception_ptr error);
+
+    template <typename Cache, typename Loader>
+    void refresh(Cache& cache, const Key& key, uint64_t observed, const Loader& loader);
+};
+
+}  // namespace kvcache
+
+#include "cache_loader.tpp"  // Template implementation
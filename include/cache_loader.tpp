@@ -0,0 +1,281 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "cache_loader.h"
+
+namespace kvcache {
+
+namespace loader_detail {
+
+// A loader may answer synchronously or with a future
+template <typename R>
+decltype(auto) await(R&& result) {
+    if constexpr (requires { result.wait(); }) {
+        return result.get();
+    } else {
+        return std::forward<R>(result);
+    }
+}
+
+}  // namespace loader_detail
+
+template <typename Key, typename Value, typename Hash>
+CacheLoader<Key, Value, Hash>::CacheLoader(const Options& options)
+    : options_(options), pool_(std::max<size_t>(options.threads, 1)) {
+    size_t per_stripe = std::max<size_t>(options_.max_records / kStripes, 1);
+    for (auto& s : stripes_) {
+        s.records = std::make_unique<LRUCache<Key, Record, FifoEviction>>(per_stripe);
+        s.records->setEvictionListener([&s](const Key& key, const Record& record) {
+            if (record.version) s.dropped.emplace_back(key, record.version);
+        });
+    }
+}
+
+template <typename Key, typename Value, typename Hash>
+template <typename Cache, typename Loader>
+std::optional<Value> CacheLoader<Key, Value, Hash>::getOrLoad(Cache& cache, const Key& key, Loader&& loader) {
+    uint64_t version = 0;
+    bool stale = false;
+    if (auto hit = lookup(cache, key, version, stale)) {
+        if (stale) refresh(cache, key, version, loader);
+        return std::move(*hit);
+    }
+
+    auto [flight, leader] = join(key);
+    if (leader) {
+        run(cache, key, *flight, version, loader);
+    } else {
+        stats_.coalesced++;
+    }
+    return flight->future.get();
+}
+
+template <typename Key, typename Value, typename Hash>
+template <typename Cache, typename Loader>
+std::shared_future<std::optional<Value>> CacheLoader<Key, Value, Hash>::getOrLoadAsync(Cache& cache, const Key& key,
+                                                                                       Loader loader) {
+    uint64_t version = 0;
+    bool stale = false;
+    if (auto hit = lookup(cache, key, version, stale)) {
+        if (stale) refresh(cache, key, version, loader);
+        std::promise<Result> ready;
+        ready.set_value(std::move(*hit));
+        return ready.get_future().share();
+    }
+
+    auto [flight, leader] = join(key);
+    if (!leader) {
+        stats_.coalesced++;
+        return flight->future;
+    }
+    pool_.enqueue([this, &cache, key, flight, version, loader = std::move(loader)]() mutable {
+        run(cache, key, *flight, version, loader);
+    });
+    return flight->future;
+}
+
+template <typename Key, typename Value, typename Hash>
+template <typename Cache, typename BatchLoader>
+std::vector<std::optional<Value>> CacheLoader<Key, Value, Hash>::getAllOrLoad(Cache& cache,
+                                                                              const std::vector<Key>& keys,
+                                                                              BatchLoader&& loader) {
+    std::vector<Result> results(keys.size());
+    std::vector<std::pair<size_t, std::shared_ptr<Flight>>> waits;
+    Batch misses, stale;
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        uint64_t version = 0;
+        bool due = false;
+        if (auto hit = lookup(cache, keys[i], version, due)) {
+            results[i] = std::move(*hit);
+            if (due) {
+                auto [flight, leader] = join(keys[i]);
+                if (leader) stale.add(keys[i], std::move(flight), version);
+            }
+            continue;
+        }
+
+        auto [flight, leader] = join(keys[i]);
+        if (leader) {
+            misses.add(keys[i], flight, version);
+        } else {
+            stats_.coalesced++;
+        }
+        waits.emplace_back(i, std::move(flight));
+    }
+
+    if (!stale.keys.empty()) {
+        stats_.refreshes += stale.keys.size();
+        pool_.enqueue([this, &cache, stale = std::move(stale), loader = std::decay_t<BatchLoader>(loader)]() mutable {
+            runBatch(cache, stale, loader);
+        });
+    }
+    if (!misses.keys.empty()) {
+        runBatch(cache, misses, loader);
+    }
+
+    for (auto& [i, flight] : waits) {
+        results[i] = flight->future.get();
+    }
+    return results;
+}
+
+template <typename Key, typename Value, typename Hash>
+template <typename Cache>
+std::optional<std::optional<Value>> CacheLoader<Key, Value, Hash>::lookup(Cache& cache, const Key& key,
+                                                                          uint64_t& version, bool& stale) {
+    if (options_.ttl.count() == 0) {
+        if (auto value = cache.get(key)) return std::make_optional<Result>(std::move(*value));
+    } else if (auto entry = cache.getVersioned(key)) {
+        auto record = stripe(key).records->get(key);
+        if (!record || record->version != entry->second) {
+            return std::make_optional<Result>(std::move(entry->first));
+        }
+
+        auto age = Clock::now() - record->at;
+        if (age < options_.ttl) {
+            if (options_.refresh_ahead > 0 && age >= options_.ttl * options_.refresh_ahead) {
+                stale = true;
+                version = entry->second;
+            }
+            return std::make_optional<Result>(std::move(entry->first));
+        }
+        stats_.expired++;
+        version = entry->second;
+        return std::nullopt;
+    }
+
+    if (options_.negative_ttl.count() > 0) {
+        auto record = stripe(key).records->get(key);
+        if (record && record->version == 0 && Clock::now() - record->at < options_.negative_ttl) {
+            stats_.negative_hits++;
+            return std::make_optional<Result>();
+        }
+    }
+    return std::nullopt;
+}
+
+template <typename Key, typename Value, typename Hash>
+std::pair<std::shared_ptr<typename CacheLoader<Key, Value, Hash>::Flight>, bool> CacheLoader<Key, Value, Hash>::join(
+    const Key& key) {
+    Stripe& s = stripe(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto [it, inserted] = s.flights.try_emplace(key);
+    if (inserted) {
+        it->second = std::make_shared<Flight>();
+    }
+    return {it->second, inserted};
+}
+
+template <typename Key, typename Value, typename Hash>
+template <typename Cache, typename Loader>
+void CacheLoader<Key, Value, Hash>::run(Cache& cache, const Key& key, Flight& flight, uint64_t observed,
+                                        Loader& loader) {
+    try {
+        Result loaded = loader_detail::await(loader());
+        stats_.loads++;
+        complete(cache, key, flight, observed, loaded);
+    } catch (...) {
+        fail(key, flight, std::current_exception());
+    }
+}
+
+template <typename Key, typename Value, typename Hash>
+template <typename Cache, typename BatchLoader>
+void CacheLoader<Key, Value, Hash>::runBatch(Cache& cache, const Batch& batch, BatchLoader& loader) {
+    size_t done = 0;
+    try {
+        std::vector<Result> loaded = loader_detail::await(loader(batch.keys));
+        if (loaded.size() != batch.keys.size()) {
+            throw std::runtime_error("Batch loader returned " + std::to_string(loaded.size()) + " values for " +
+                                     std::to_string(batch.keys.size()) + " keys");
+        }
+        stats_.loads += batch.keys.size();
+        for (; done < batch.keys.size(); ++done) {
+            complete(cache, batch.keys[done], *batch.flights[done], batch.versions[done], loaded[done]);
+        }
+    } catch (...) {
+        for (; done < batch.keys.size(); ++done) {
+            fail(batch.keys[done], *batch.flights[done], std::current_exception());
+        }
+    }
+}
+
+template <typename Key, typename Value, typename Hash>
+template <typename Cache>
+void CacheLoader<Key, Value, Hash>::complete(Cache& cache, const Key& key, Flight& flight, uint64_t observed,
+                                             const Result& loaded) {
+    Stripe& s = stripe(key);
+    Result result = loaded;
+    if (loaded) {
+        // A write that landed while loading is newer than what the loader saw: keep it
+        uint64_t version = cache.update(key, [&](const Value* current, uint64_t v) -> std::optional<Value> {
+            if (current && v != observed) {
+                result = *current;
+                return std::nullopt;
+            }
+            return loaded;
+        });
+        if (version && options_.ttl.count() > 0) {
+            remember(cache, s, key, Record{version, Clock::now()});
+        } else {
+            s.records->remove(key);
+        }
+    } else {
+        if (observed) {
+            // Expired and gone from the source, unless written meanwhile
+            cache.removeIf(key, [observed](const Value&, uint64_t v) { return v == observed; });
+        }
+        if (options_.negative_ttl.count() > 0) {
+            remember(cache, s, key, Record{0, Clock::now()});
+        }
+    }
+
+    // Only now, so a caller arriving after the flight is gone finds the entry
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.flights.erase(key);
+    }
+    flight.promise.set_value(std::move(result));
+}
+
+template <typename Key, typename Value, typename Hash>
+template <typename Cache>
+void CacheLoader<Key, Value, Hash>::remember(Cache& cache, Stripe& s, const Key& key, const Record& record) {
+    std::vector<std::pair<Key, uint64_t>> dropped;
+    s.records->withLock([&](auto& records) {
+        records.put(key, record);
+        dropped.swap(s.dropped);
+    });
+    // Without its record the entry could never expire; unless written since, it goes too
+    for (const auto& [k, version] : dropped) {
+        cache.removeIf(k, [version](const Value&, uint64_t v) { return v == version; });
+    }
+}
+
+template <typename Key, typename Value, typename Hash>
+void CacheLoader<Key, Value, Hash>::fail(const Key& key, Flight& flight, std::exception_ptr error) {
+    Stripe& s = stripe(key);
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.flights.erase(key);
+    }
+    flight.promise.set_exception(error);
+}
+
+template <typename Key, typename Value, typename Hash>
+template <typename Cache, typename Loader>
+void CacheLoader<Key, Value, Hash>::refresh(Cache& cache, const Key& key, uint64_t observed, const Loader& loader) {
+    auto [flight, leader] = join(key);
+    if (!leader) return;  // Already being loaded
+
+    stats_.refreshes++;
+    pool_.enqueue([this, &cache, key, flight, observed, loader = std::decay_t<Loader>(loader)]() mutable {
+        run(cache, key, *flight, observed, loader);
+    });
+}
+
+}  // namespace kvcache
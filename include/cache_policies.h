@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <type_traits>
+
+namespace kvcache {
+
+// Compile-time policies for LRUCache / ShardedCache. Every policy is a plain type
+// with inline static or member functions, so each combination is its own specialization.
+
+// ---------------------------------------------------------------------------
+// Eviction: what a hit does to the recency list. The back of the list is evicted.
+// ---------------------------------------------------------------------------
+
+// Least recently used: a hit moves the entry to the front
+struct LruEviction {
+    static constexpr bool kMutatesOnHit = true;
+
+    template <typename List, typename Iterator>
+    static void onHit(List& items, Iterator it) {
+        items.splice(items.begin(), items, it);
+    }
+};
+
+// First in, first out: hits leave the order alone, so reads never relink nodes and
+// can share a reader lock
+struct FifoEviction {
+    static constexpr bool kMutatesOnHit = false;
+
+    template <typename List, typename Iterator>
+    static void onHit(List&, Iterator) {
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Locks: std::mutex and std::shared_mutex work as-is, plus these two.
+// ---------------------------------------------------------------------------
+
+// Test-and-test-and-set spinlock for very short critical sections
+class SpinLock {
+public:
+    void lock() {
+        while (flag_.test_and_set(std::memory_order_acquire)) {
+            while (flag_.test(std::memory_order_relaxed)) {
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+            }
+        }
+    }
+
+    bool try_lock() {
+        return !flag_.test_and_set(std::memory_order_acquire);
+    }
+
+    void unlock() {
+        flag_.clear(std::memory_order_release);
+    }
+
+private:
+    std::atomic_flag flag_ = ATOMIC_FLAG_INIT;
+};
+
+// No locking at all, for caches owned by a single thread
+struct NullLock {
+    void lock() {
+    }
+    bool try_lock() {
+        return true;
+    }
+    void unlock() {
+    }
+};
+
+// Guard for read-only operations: shared when the lock supports it
+template <typename Lock>
+using ReadGuard = std::conditional_t<requires(Lock& l) { l.lock_shared(); }, std::shared_lock<Lock>,
+                                     std::lock_guard<Lock>>;
+
+// ---------------------------------------------------------------------------
+// Hash mixers: applied to the key hash before the shard is picked by mask.
+// ---------------------------------------------------------------------------
+
+// Uses the hash as-is. std::hash of integers is the identity, so keys with a
+// power-of-two stride all land in the same shard.
+struct IdentityMixer {
+    static uint64_t mix(uint64_t h) {
+        return h;
+    }
+};
+
+// murmur3 fmix64 finalizer: every input bit affects the low bits used for routing
+struct Murmur3Mixer {
+    static uint64_t mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+};
+
+}  // namespace kvcache
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace kvcache {
+
+// Consistent hash ring with virtual nodes.
+// Each node is placed on the ring `vnodes` times; a key belongs to the first point at or
+// after its hash. Adding or removing one of N nodes only moves about 1/N of the keys.
+class HashRing {
+public:
+    explicit HashRing(size_t vnodes = 160) : vnodes_(vnodes) {
+    }
+
+    void addNode(const std::string& node) {
+        for (const auto& n : nodes_) {
+            if (n == node) return;
+        }
+        nodes_.push_back(node);
+        for (size_t i = 0; i < vnodes_; ++i) {
+            ring_[hash(node + "#" + std::to_string(i))] = node;
+        }
+    }
+
+    void removeNode(const std::string& node) {
+        for (auto it = nodes_.begin(); it != nodes_.end(); ++it) {
+            if (*it == node) {
+                nodes_.erase(it);
+                break;
+            }
+        }
+        for (auto it = ring_.begin(); it != ring_.end();) {
+            if (it->second == node) {
+                it = ring_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // Ring must not be empty
+    const std::string& locate(std::string_view key) const {
+        auto it = ring_.lower_bound(hash(key));
+        if (it == ring_.end()) it = ring_.begin();
+        return it->second;
+    }
+
+    bool empty() const {
+        return nodes_.empty();
+    }
+
+    const std::vector<std::string>& nodes() const {
+        return nodes_;
+    }
+
+    // FNV-1a followed by a murmur3 finalizer so that similar keys spread over the ring
+    static uint64_t hash(std::string_view data) {
+        uint64_t h = 14695981039346656037ULL;
+        for (unsigned char c : data) {
+            h ^= c;
+            h *= 1099511628211ULL;
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+private:
+    size_t vnodes_;
+    std::vector<std::string> nodes_;
+    std::map<uint64_t, std::string> ring_;
+};
+
+}  // namespace kvcache
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "cache_policies.h"
+
+namespace kvcache {
+
+// Finds heavy hitters among GETs and serves them from per-thread read-only copies, so a
+// single popular key stops serializing its readers on one shard lock.
+//
+// One in sample_every GETs feeds a space-saving sketch. Each thread counts its samples on
+// its own and merges them into the sketch every merge_every samples, so the sketch's lock
+// is rarely taken. At the end of every window the keys holding at least hot_share of the
+// samples become the hot set. Copies are validated
+// against a striped version counter that every write bumps after changing the shard, so a
+// copy taken before a write is never served after it. What a thread holds for a destroyed
+// tracker is freed the next time it turns to another tracker.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class HotKeyTracker {
+public:
+    struct Options {
+        size_t sample_every = 8;   // 1 in N GETs is sampled
+        size_t counters = 64;      // Space-saving sketch size
+        size_t window = 1024;      // Samples per evaluation
+        double hot_share = 0.05;   // Share of a window's samples that makes a key hot; keep above 1 / counters,
+                                   // the sketch's overestimation bound
+        size_t max_hot = 16;
+        size_t merge_every = 32;    // Samples a thread counts locally before merging them
+        size_t refresh_every = 64;  // 1 in N reads of a copy goes to the shard, keeping the key
+                                    // recent there so it is not evicted while hot
+    };
+
+    explicit HotKeyTracker(const Options& options = Options());
+
+    HotKeyTracker(const HotKeyTracker&) = delete;
+    HotKeyTracker& operator=(const HotKeyTracker&) = delete;
+
+    // Serves key from the calling thread's copy when valid, otherwise calls load() (the shard
+    // read) and keeps a copy if the key is hot
+    template <typename Load>
+    std::optional<Value> get(const Key& key, Load&& load);
+
+    // Call after every write to key, before acknowledging it
+    void invalidate(const Key& key);
+    void invalidateAll();
+
+    // Estimated GETs per key in the last completed window, hottest first
+    std::vector<std::pair<Key, uint64_t>> topKeys() const;
+    std::vector<Key> hotKeys() const;
+    // GETs served from per-thread copies
+    uint64_t copyHits() const;
+
+private:
+    using HotSet = std::unordered_set<Key, Hash>;
+
+    static constexpr size_t kStripes = 1024;
+    struct alignas(64) Stripe {
+        std::atomic<uint64_t> version{0};
+    };
+
+    struct Copy {
+        Value value;
+        uint64_t version;
+        size_t served = 0;
+    };
+
+    struct alignas(64) HitCounter {
+        std::atomic<uint64_t> hits{0};
+    };
+
+    // State of one thread for one tracker
+    struct Local {
+        std::weak_ptr<const char> owner;  // Expired once the tracker is gone
+        uint64_t generation = UINT64_MAX;
+        std::shared_ptr<const HotSet> hot;
+        std::unordered_map<Key, Copy, Hash> copies;
+        size_t tick = 0;
+        std::shared_ptr<HitCounter> counter;
+        std::unordered_map<Key, uint64_t, Hash> samples;  // Not merged yet
+        size_t sampled = 0;
+    };
+
+    struct Counter {
+        Key key;
+        uint64_t count;
+    };
+
+    Options options_;
+    uint64_t id_;  // Tells trackers apart in thread-local storage
+    std::shared_ptr<const char> alive_ = std::make_shared<const char>();  // See Local::owner
+    Hash hash_;
+    std::array<Stripe, kStripes> stripes_;
+    std::atomic<uint64_t> generation_{0};
+
+    mutable std::mutex mutex_;  // Protects everything below
+    std::shared_ptr<const HotSet> hot_;
+    std::vector<Counter> sketch_;
+    std::unordered_map<Key, size_t, Hash> sketch_index_;
+    size_t samples_ = 0;
+    std::vector<std::pair<Key, uint64_t>> top_;
+    std::vector<std::shared_ptr<HitCounter>> counters_;
+
+    Local& local();
+    Stripe& stripe(const Key& key) {
+        return stripes_[Murmur3Mixer::mix(hash_(key)) & (kStripes - 1)];
+    }
+    void sample(Local& l, const Key& key);
+    void countLocked(const Key& key, uint64_t count);
+    void endWindowLocked();
+};
+
+}  // namespace kvcache
+
+#include "hot_keys.tpp"  // Template implementation
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+
+#include "hot_keys.h"
+
+namespace kvcache {
+
+inline std::atomic<uint64_t>& hotKeyTrackerIds() {
+    static std::atomic<uint64_t> next_id{0};
+    return next_id;
+}
+
+template <typename Key, typename Value, typename Hash>
+HotKeyTracker<Key, Value, Hash>::HotKeyTracker(const Options& options)
+    : options_(options), id_(hotKeyTrackerIds()++), hot_(std::make_shared<const HotSet>()) {
+    options_.sample_every = std::max<size_t>(options_.sample_every, 1);
+    options_.counters = std::max<size_t>(options_.counters, 1);
+    options_.merge_every = std::max<size_t>(options_.merge_every, 1);
+    options_.refresh_every = std::max<size_t>(options_.refresh_every, 1);
+}
+
+template <typename Key, typename Value, typename Hash>
+typename HotKeyTracker<Key, Value, Hash>::Local& HotKeyTracker<Key, Value, Hash>::local() {
+    // Keyed by id rather than address, so a new tracker never sees a dead one's copies
+    static thread_local std::unordered_map<uint64_t, Local> locals;
+    static thread_local std::pair<uint64_t, Local*> last{UINT64_MAX, nullptr};
+    if (last.first == id_) return *last.second;
+
+    // Switching trackers: drop what this thread holds for destroyed ones
+    std::erase_if(locals, [](const auto& item) { return item.second.owner.expired(); });
+
+    Local& l = locals[id_];
+    if (!l.counter) {
+        l.owner = alive_;
+        l.counter = std::make_shared<HitCounter>();
+        std::lock_guard<std::mutex> lock(mutex_);
+        counters_.push_back(l.counter);
+    }
+    last = {id_, &l};
+    return l;
+}
+
+template <typename Key, typename Value, typename Hash>
+template <typename Load>
+std::optional<Value> HotKeyTracker<Key, Value, Hash>::get(const Key& key, Load&& load) {
+    Local& l = local();
+
+    uint64_t generation = generation_.load(std::memory_order_acquire);
+    if (l.generation != generation) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        l.hot = hot_;
+        l.generation = generation_.load(std::memory_order_relaxed);
+        // Drop copies of keys that cooled down
+        std::erase_if(l.copies, [&l](const auto& item) { return !l.hot->count(item.first); });
+    }
+
+    if (!l.copies.empty()) {
+        auto it = l.copies.find(key);
+        if (it != l.copies.end()) {
+            // Every refresh_every-th read retakes the copy from the shard, which also marks
+            // the key as recently used there
+            if (it->second.version == stripe(key).version.load(std::memory_order_acquire) &&
+                ++it->second.served % options_.refresh_every != 0) {
+                l.counter->hits.fetch_add(1, std::memory_order_relaxed);
+                return it->second.value;
+            }
+            l.copies.erase(it);
+        }
+    }
+
+    if (++l.tick % options_.sample_every == 0) {
+        sample(l, key);
+    }
+
+    if (l.hot->empty() || !l.hot->count(key)) {
+        return load();
+    }
+
+    // Read the version before the value: a write landing in between makes the copy stale
+    // at once instead of letting it outlive the write
+    uint64_t version = stripe(key).version.load(std::memory_order_acquire);
+    std::optional<Value> value = load();
+    if (value) {
+        l.copies[key] = Copy{*value, version};
+    }
+    return value;
+}
+
+template <typename Key, typename Value, typename Hash>
+void HotKeyTracker<Key, Value, Hash>::invalidate(const Key& key) {
+    stripe(key).version.fetch_add(1, std::memory_order_release);
+}
+
+template <typename Key, typename Value, typename Hash>
+void HotKeyTracker<Key, Value, Hash>::invalidateAll() {
+    for (auto& s : stripes_) {
+        s.version.fetch_add(1, std::memory_order_release);
+    }
+}
+
+template <typename Key, typename Value, typename Hash>
+void HotKeyTracker<Key, Value, Hash>::sample(Local& l, const Key& key) {
+    // Repeats of a hot key collapse into one counter update
+    l.samples[key]++;
+    if (++l.sampled < options_.merge_every) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& [k, count] : l.samples) {
+        countLocked(k, count);
+    }
+    samples_ += l.sampled;
+    l.samples.clear();
+    l.sampled = 0;
+
+    if (samples_ >= options_.window) {
+        endWindowLocked();
+    }
+}
+
+// Space-saving: a new key replaces the smallest counter and inherits its count
+template <typename Key, typename Value, typename Hash>
+void HotKeyTracker<Key, Value, Hash>::countLocked(const Key& key, uint64_t count) {
+    auto it = sketch_index_.find(key);
+    if (it != sketch_index_.end()) {
+        sketch_[it->second].count += count;
+    } else if (sketch_.size() < options_.counters) {
+        sketch_index_[key] = sketch_.size();
+        sketch_.push_back(Counter{key, count});
+    } else {
+        auto min = std::min_element(sketch_.begin(), sketch_.end(),
+                                    [](const Counter& a, const Counter& b) { return a.count < b.count; });
+        sketch_index_.erase(min->key);
+        sketch_index_[key] = min - sketch_.begin();
+        min->key = key;
+        min->count += count;
+    }
+}
+
+template <typename Key, typename Value, typename Hash>
+void HotKeyTracker<Key, Value, Hash>::endWindowLocked() {
+    std::sort(sketch_.begin(), sketch_.end(), [](const Counter& a, const Counter& b) { return a.count > b.count; });
+
+    auto hot = std::make_shared<HotSet>();
+    top_.clear();
+    for (const auto& counter : sketch_) {
+        if (hot->size() < options_.max_hot && counter.count >= options_.hot_share * samples_) {
+            hot->insert(counter.key);
+        }
+        top_.emplace_back(counter.key, counter.count * options_.sample_every);
+    }
+
+    if (*hot != *hot_) {
+        hot_ = std::move(hot);
+        generation_.fetch_add(1, std::memory_order_release);
+    }
+
+    sketch_.clear();
+    sketch_index_.clear();
+    samples_ = 0;
+}
+
+template <typename Key, typename Value, typename Hash>
+std::vector<std::pair<Key, uint64_t>> HotKeyTracker<Key, Value, Hash>::topKeys() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return top_;
+}
+
+template <typename Key, typename Value, typename Hash>
+std::vector<Key> HotKeyTracker<Key, Value, Hash>::hotKeys() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::vector<Key>(hot_->begin(), hot_->end());
+}
+
+template <typename Key, typename Value, typename Hash>
+uint64_t HotKeyTracker<Key, Value, Hash>::copyHits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t total = 0;
+    for (const auto& counter : counters_) {
+        total += counter->hits.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+}  // namespace kvcache
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <list>
 #include <memory>
 #include <mutex>
@@ -7,9 +10,13 @@
 #include <string>
 #include <unordered_map>
 
+#include "cache_policies.h"
+
 namespace kvcache {
 
-template <typename Key, typename Value>
+// Bounded map that evicts from the back of a recency list. The eviction policy decides
+// how hits reorder that list (LRU by default) and the lock policy how it is guarded.
+template <typename Key, typename Value, typename Eviction = LruEviction, typename Lock = std::mutex>
 class LRUCache {
 public:
     explicit LRUCache(size_t capacity);
@@ -22,8 +29,82 @@ public:
     void put(const Key& key, const Value& value);
     std::optional<Value> get(const Key& key);
     bool exists(const Key& key);
+    bool remove(const Key& key);
+    void clear();
     size_t size() const;
 
+    // Every write stamps the entry with a new version, unique within this cache
+    std::optional<std::pair<Value, uint64_t>> getVersioned(const Key& key);
+
+    // Read-modify-write in one critical section. fn(const Value* current, uint64_t version)
+    // sees nullptr/0 when the key is absent and returns the value to store, or std::nullopt
+    // to leave the entry alone. Returns the new version, or 0 if nothing was written.
+    template <typename F>
+    uint64_t update(const Key& key, F&& fn);
+
+    // Removes the key; on_remove() runs under the lock only if the key existed
+    template <typename F>
+    bool remove(const Key& key, F&& on_remove);
+
+    // Removes the key only if pred(const Value&, uint64_t version) holds, under the lock
+    template <typename P>
+    bool removeIf(const Key& key, P&& pred);
+
+    // Visit every entry (MRU first) under the lock, e.g. to build a snapshot
+    template <typename F>
+    void forEach(F&& fn) const;
+
+    // For snapshots spanning several caches: hold acquire() while calling forEachLocked()
+    std::unique_lock<Lock> acquire() const {
+        return std::unique_lock<Lock>(mutex_);
+    }
+    template <typename F>
+    void forEachLocked(F&& fn) const;
+
+    // The basic operations without locking, for use inside withLock()
+    class Locked {
+    public:
+        explicit Locked(LRUCache& cache) : cache_(cache) {
+        }
+
+        std::optional<Value> get(const Key& key) {
+            return cache_.getLocked(key);
+        }
+        void put(const Key& key, const Value& value) {
+            cache_.putLocked(key, value);
+        }
+        template <typename F>
+        uint64_t update(const Key& key, F&& fn) {
+            return cache_.updateLocked(key, std::forward<F>(fn));
+        }
+        template <typename F>
+        bool remove(const Key& key, F&& on_remove) {
+            return cache_.removeLocked(key, std::forward<F>(on_remove));
+        }
+
+        // Starts loading the first node of key's bucket, so a run of prefetches ahead of
+        // the lookups overlaps their cache misses
+        void prefetch(const Key& key) const;
+
+    private:
+        LRUCache& cache_;
+    };
+
+    // Runs fn(Locked&) in one critical section, for callers with several operations on
+    // this cache at hand
+    template <typename F>
+    void withLock(F&& fn) {
+        std::lock_guard<Lock> lock(mutex_);
+        Locked locked(*this);
+        fn(locked);
+    }
+
+    // Receives every entry evicted for capacity (not removed or cleared ones), under the lock
+    using EvictionListener = std::function<void(const Key&, const Value&)>;
+    void setEvictionListener(EvictionListener listener) {
+        on_evict_ = std::move(listener);
+    }
+
     // Stats
     struct Stats {
         size_t hits = 0;
@@ -32,11 +113,35 @@ public:
     Stats getStats() const;
 
 private:
+    struct Entry {
+        Key key;
+        Value value;
+        uint64_t version;
+    };
+
     size_t capacity_;
-    std::list<std::pair<Key, Value>> items_;  // Doubly linked list: Most recent at front
-    std::unordered_map<Key, typename std::list<std::pair<Key, Value>>::iterator> cache_map_;
-    mutable std::mutex mutex_;  // Protects items_ and cache_map_
-    Stats stats_;
+    std::list<Entry> items_;  // Doubly linked list: Most recent at front
+    std::unordered_map<Key, typename std::list<Entry>::iterator> cache_map_;
+    mutable Lock mutex_;  // Protects items_ and cache_map_
+    // Atomic so readers holding a shared lock can count
+    struct Counters {
+        std::atomic<size_t> hits{0};
+        std::atomic<size_t> misses{0};
+    };
+    Counters stats_;
+    uint64_t next_version_ = 0;
+    EvictionListener on_evict_;
+
+    // Exclusive when a hit reorders the list, shared otherwise
+    using GetGuard = std::conditional_t<Eviction::kMutatesOnHit, std::lock_guard<Lock>, ReadGuard<Lock>>;
+
+    void insertLocked(const Key& key, const Value& value);
+    void putLocked(const Key& key, const Value& value);
+    std::optional<Value> getLocked(const Key& key);
+    template <typename F>
+    uint64_t updateLocked(const Key& key, F&& fn);
+    template <typename F>
+    bool removeLocked(const Key& key, F&& on_remove);
 };
 
 }  // namespace kvcache
@@ -4,66 +4,191 @@
 
 namespace kvcache {
 
-template <typename Key, typename Value>
-LRUCache<Key, Value>::LRUCache(size_t capacity) : capacity_(capacity) {
+template <typename Key, typename Value, typename Eviction, typename Lock>
+LRUCache<Key, Value, Eviction, Lock>::LRUCache(size_t capacity) : capacity_(capacity) {
 }
 
-template <typename Key, typename Value>
-void LRUCache<Key, Value>::put(const Key& key, const Value& value) {
-    std::lock_guard<std::mutex> lock(mutex_);
+template <typename Key, typename Value, typename Eviction, typename Lock>
+void LRUCache<Key, Value, Eviction, Lock>::put(const Key& key, const Value& value) {
+    std::lock_guard<Lock> lock(mutex_);
+    putLocked(key, value);
+}
 
+template <typename Key, typename Value, typename Eviction, typename Lock>
+void LRUCache<Key, Value, Eviction, Lock>::putLocked(const Key& key, const Value& value) {
     auto it = cache_map_.find(key);
     if (it != cache_map_.end()) {
-        // Update value and move to front
-        it->second->second = value;
-        items_.splice(items_.begin(), items_, it->second);
+        // Update value and refresh its position
+        it->second->value = value;
+        it->second->version = ++next_version_;
+        Eviction::onHit(items_, it->second);
         return;
     }
 
-    // Insert new item
+    insertLocked(key, value);
+}
+
+template <typename Key, typename Value, typename Eviction, typename Lock>
+void LRUCache<Key, Value, Eviction, Lock>::insertLocked(const Key& key, const Value& value) {
     if (items_.size() >= capacity_) {
-        // Evict least recently used (back)
-        auto last = items_.back();
-        cache_map_.erase(last.first);
+        // Evict from the back
+        if (on_evict_) on_evict_(items_.back().key, items_.back().value);
+        cache_map_.erase(items_.back().key);
         items_.pop_back();
     }
 
-    items_.emplace_front(key, value);
+    items_.push_front(Entry{key, value, ++next_version_});
     cache_map_[key] = items_.begin();
 }
 
-template <typename Key, typename Value>
-std::optional<Value> LRUCache<Key, Value>::get(const Key& key) {
-    std::lock_guard<std::mutex> lock(mutex_);
+template <typename Key, typename Value, typename Eviction, typename Lock>
+std::optional<Value> LRUCache<Key, Value, Eviction, Lock>::get(const Key& key) {
+    GetGuard lock(mutex_);
+    return getLocked(key);
+}
+
+template <typename Key, typename Value, typename Eviction, typename Lock>
+std::optional<Value> LRUCache<Key, Value, Eviction, Lock>::getLocked(const Key& key) {
+    auto it = cache_map_.find(key);
+    if (it == cache_map_.end()) {
+        stats_.misses.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+
+    stats_.hits.fetch_add(1, std::memory_order_relaxed);
+    Eviction::onHit(items_, it->second);
+    return it->second->value;
+}
+
+template <typename Key, typename Value, typename Eviction, typename Lock>
+std::optional<std::pair<Value, uint64_t>> LRUCache<Key, Value, Eviction, Lock>::getVersioned(const Key& key) {
+    GetGuard lock(mutex_);
 
     auto it = cache_map_.find(key);
     if (it == cache_map_.end()) {
-        stats_.misses++;
+        stats_.misses.fetch_add(1, std::memory_order_relaxed);
         return std::nullopt;
     }
 
-    stats_.hits++;
-    // Move to front (mark as recently used)
-    items_.splice(items_.begin(), items_, it->second);
-    return it->second->second;
+    stats_.hits.fetch_add(1, std::memory_order_relaxed);
+    Eviction::onHit(items_, it->second);
+    return std::make_pair(it->second->value, it->second->version);
 }
 
-template <typename Key, typename Value>
-bool LRUCache<Key, Value>::exists(const Key& key) {
-    std::lock_guard<std::mutex> lock(mutex_);
+template <typename Key, typename Value, typename Eviction, typename Lock>
+template <typename F>
+uint64_t LRUCache<Key, Value, Eviction, Lock>::update(const Key& key, F&& fn) {
+    std::lock_guard<Lock> lock(mutex_);
+    return updateLocked(key, std::forward<F>(fn));
+}
+
+template <typename Key, typename Value, typename Eviction, typename Lock>
+template <typename F>
+uint64_t LRUCache<Key, Value, Eviction, Lock>::updateLocked(const Key& key, F&& fn) {
+    auto it = cache_map_.find(key);
+    if (it == cache_map_.end()) {
+        std::optional<Value> value = fn(static_cast<const Value*>(nullptr), uint64_t{0});
+        if (!value) return 0;
+        insertLocked(key, *value);
+        return next_version_;
+    }
+
+    std::optional<Value> value = fn(static_cast<const Value*>(&it->second->value), it->second->version);
+    if (!value) return 0;
+    it->second->value = std::move(*value);
+    it->second->version = ++next_version_;
+    Eviction::onHit(items_, it->second);
+    return next_version_;
+}
+
+template <typename Key, typename Value, typename Eviction, typename Lock>
+bool LRUCache<Key, Value, Eviction, Lock>::exists(const Key& key) {
+    ReadGuard<Lock> lock(mutex_);
     return cache_map_.find(key) != cache_map_.end();
 }
 
-template <typename Key, typename Value>
-size_t LRUCache<Key, Value>::size() const {
-    std::lock_guard<std::mutex> lock(mutex_);
+template <typename Key, typename Value, typename Eviction, typename Lock>
+bool LRUCache<Key, Value, Eviction, Lock>::remove(const Key& key) {
+    return remove(key, [] {});
+}
+
+template <typename Key, typename Value, typename Eviction, typename Lock>
+template <typename F>
+bool LRUCache<Key, Value, Eviction, Lock>::remove(const Key& key, F&& on_remove) {
+    std::lock_guard<Lock> lock(mutex_);
+    return removeLocked(key, std::forward<F>(on_remove));
+}
+
+template <typename Key, typename Value, typename Eviction, typename Lock>
+template <typename F>
+bool LRUCache<Key, Value, Eviction, Lock>::removeLocked(const Key& key, F&& on_remove) {
+    auto it = cache_map_.find(key);
+    if (it == cache_map_.end()) {
+        return false;
+    }
+
+    on_remove();
+    items_.erase(it->second);
+    cache_map_.erase(it);
+    return true;
+}
+
+template <typename Key, typename Value, typename Eviction, typename Lock>
+template <typename P>
+bool LRUCache<Key, Value, Eviction, Lock>::removeIf(const Key& key, P&& pred) {
+    std::lock_guard<Lock> lock(mutex_);
+
+    auto it = cache_map_.find(key);
+    if (it == cache_map_.end() || !pred(static_cast<const Value&>(it->second->value), it->second->version)) {
+        return false;
+    }
+
+    items_.erase(it->second);
+    cache_map_.erase(it);
+    return true;
+}
+
+template <typename Key, typename Value, typename Eviction, typename Lock>
+void LRUCache<Key, Value, Eviction, Lock>::Locked::prefetch(const Key& key) const {
+    const auto& map = cache_.cache_map_;
+    size_t bucket = map.bucket(key);
+    auto node = map.begin(bucket);
+    if (node != map.end(bucket)) {
+        __builtin_prefetch(&*node);
+    }
+}
+
+template <typename Key, typename Value, typename Eviction, typename Lock>
+void LRUCache<Key, Value, Eviction, Lock>::clear() {
+    std::lock_guard<Lock> lock(mutex_);
+    cache_map_.clear();
+    items_.clear();
+}
+
+template <typename Key, typename Value, typename Eviction, typename Lock>
+template <typename F>
+void LRUCache<Key, Value, Eviction, Lock>::forEach(F&& fn) const {
+    ReadGuard<Lock> lock(mutex_);
+    forEachLocked(fn);
+}
+
+template <typename Key, typename Value, typename Eviction, typename Lock>
+template <typename F>
+void LRUCache<Key, Value, Eviction, Lock>::forEachLocked(F&& fn) const {
+    for (const auto& item : items_) {
+        fn(item.key, item.value);
+    }
+}
+
+template <typename Key, typename Value, typename Eviction, typename Lock>
+size_t LRUCache<Key, Value, Eviction, Lock>::size() const {
+    ReadGuard<Lock> lock(mutex_);
     return items_.size();
 }
 
-template <typename Key, typename Value>
-typename LRUCache<Key, Value>::Stats LRUCache<Key, Value>::getStats() const {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return stats_;
+template <typename Key, typename Value, typename Eviction, typename Lock>
+typename LRUCache<Key, Value, Eviction, Lock>::Stats LRUCache<Key, Value, Eviction, Lock>::getStats() const {
+    return Stats{stats_.hits.load(std::memory_order_relaxed), stats_.misses.load(std::memory_order_relaxed)};
 }
 
 }  // namespace kvcache
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace kvcache {
+
+// CPUs and memory nodes of the machine, read from sysfs. Without NUMA support the
+// machine is a single node 0 holding every CPU.
+class NumaTopology {
+public:
+    struct Node {
+        int id;
+        std::vector<int> cpus;
+    };
+
+    explicit NumaTopology(std::vector<Node> nodes);
+
+    // Every node with CPUs
+    static NumaTopology detect();
+    // CPUs in the process's affinity mask
+    static std::vector<int> allowedCpus();
+
+    const std::vector<Node>& nodes() const {
+        return nodes_;
+    }
+    // -1 if cpu is not part of the topology
+    int nodeOf(int cpu) const;
+
+    // Keeps only the given CPUs; nodes left without CPUs are dropped
+    NumaTopology restrictTo(const std::vector<int>& cpus) const;
+
+private:
+    std::vector<Node> nodes_;
+};
+
+// Kernel list syntax as in /sys/devices/system/node/node0/cpulist: "0-3,8,10-11".
+// parseRangeList throws std::invalid_argument on malformed input.
+std::vector<int> parseRangeList(const std::string& list);
+std::string formatRangeList(std::vector<int> ids);
+
+// Pins the calling thread to one CPU. Returns false if the kernel refused.
+bool pinThread(int cpu);
+
+// Places the pages of [addr, addr + len) on node (falling back to others when it is full),
+// moving those already faulted in. Only whole pages inside the range are affected.
+bool bindMemory(void* addr, size_t len, int node);
+
+}  // namespace kvcache
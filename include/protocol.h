@@ -2,8 +2,10 @@
 
 #include <arpa/inet.h>
 
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -12,8 +14,31 @@ namespace kvcache {
 // Magic: 0xCAFE
 const uint16_t MAGIC = 0xCAFE;
 const uint8_t VERSION = 1;
+// v2 frames carry a HeaderExt after the v1 header. Each frame is answered in its own
+// version, so v1 clients are unaffected.
+const uint8_t VERSION_2 = 2;
+const uint8_t MAX_VERSION = VERSION_2;
 
-enum class Command : uint8_t { SET = 1, GET = 2, DEL = 3, STATS = 4, UNKNOWN = 0 };
+// SYNC and PING are used on the replication link between primary and replica. A client
+// PING is answered with the highest protocol version the server speaks (servers without
+// v2 reply with an empty value), which is how clients negotiate v2.
+// INCR/DECR take an optional decimal delta as value; GETS replies "<version> <value>"
+// and CAS takes "<version> <value>", replying the new version, EXISTS or NOT_FOUND.
+enum class Command : uint8_t {
+    SET = 1,
+    GET = 2,
+    DEL = 3,
+    STATS = 4,
+    SYNC = 5,
+    PING = 6,
+    MGET = 7,
+    INCR = 8,
+    DECR = 9,
+    APPEND = 10,
+    GETS = 11,
+    CAS = 12,
+    UNKNOWN = 0
+};
 
 #pragma pack(push, 1)
 struct Header {
@@ -25,7 +50,20 @@ struct Header {
 };
 #pragma pack(pop)
 
+// v2: the reply echoes request_id and may arrive out of order relative to other v2 requests
+#pragma pack(push, 1)
+struct HeaderExt {
+    uint32_t request_id;
+    uint16_t flags;
+    uint16_t reserved;
+};
+#pragma pack(pop)
+
+// Runs only after every earlier request on the connection has completed, and before any later one
+const uint16_t FLAG_ORDERED = 0x1;
+
 const size_t HEADER_SIZE = sizeof(Header);
+const size_t HEADER_EXT_SIZE = sizeof(HeaderExt);
 
 struct Message {
     Header header;
@@ -51,6 +89,31 @@ struct Message {
         return buffer;
     }
 
+    static std::vector<uint8_t> encodeV2(Command cmd, const std::string& key, const std::string& value,
+                                         uint32_t request_id, uint16_t flags = 0) {
+        std::vector<uint8_t> buffer = encode(cmd, key, value);
+        buffer[offsetof(Header, version)] = VERSION_2;
+
+        HeaderExt ext{htonl(request_id), htons(flags), 0};
+        auto* bytes = reinterpret_cast<const uint8_t*>(&ext);
+        buffer.insert(buffer.begin() + HEADER_SIZE, bytes, bytes + HEADER_EXT_SIZE);
+        return buffer;
+    }
+
+    // Header bytes before the key, by version
+    static size_t headerSize(const Header& h) {
+        return h.version >= VERSION_2 ? HEADER_SIZE + HEADER_EXT_SIZE : HEADER_SIZE;
+    }
+
+    // Decodes the extension following a v2 header
+    static HeaderExt decodeExt(const uint8_t* data) {
+        HeaderExt ext;
+        std::memcpy(&ext, data + HEADER_SIZE, HEADER_EXT_SIZE);
+        ext.request_id = ntohl(ext.request_id);
+        ext.flags = ntohs(ext.flags);
+        return ext;
+    }
+
     // Helper to decode header from network byte order
     static Header decodeHeader(const uint8_t* data) {
         Header h;
@@ -62,4 +125,64 @@ struct Message {
     }
 };
 
+// MGET carries its keys in the value field as [len:4][bytes] entries. The reply value holds
+// one [found:1][len:4][bytes] entry per requested key, in request order.
+struct MultiKey {
+    static std::string packKeys(const std::vector<std::string>& keys) {
+        std::string out;
+        for (const auto& key : keys) {
+            appendLength(out, key.size());
+            out += key;
+        }
+        return out;
+    }
+
+    static bool unpackKeys(const std::string& data, std::vector<std::string>& keys) {
+        size_t pos = 0;
+        while (pos < data.size()) {
+            uint32_t len;
+            if (!readLength(data, pos, len) || data.size() - pos < len) return false;
+            keys.emplace_back(data, pos, len);
+            pos += len;
+        }
+        return true;
+    }
+
+    static std::string packValues(const std::vector<std::optional<std::string>>& values) {
+        std::string out;
+        for (const auto& value : values) {
+            out.push_back(value ? 1 : 0);
+            appendLength(out, value ? value->size() : 0);
+            if (value) out += *value;
+        }
+        return out;
+    }
+
+    static bool unpackValues(const std::string& data, std::vector<std::optional<std::string>>& values) {
+        size_t pos = 0;
+        while (pos < data.size()) {
+            bool found = data[pos++] != 0;
+            uint32_t len;
+            if (!readLength(data, pos, len) || data.size() - pos < len) return false;
+            values.emplace_back(found ? std::optional<std::string>(data.substr(pos, len)) : std::nullopt);
+            pos += len;
+        }
+        return true;
+    }
+
+private:
+    static void appendLength(std::string& out, size_t len) {
+        uint32_t n = htonl(static_cast<uint32_t>(len));
+        out.append(reinterpret_cast<const char*>(&n), sizeof(n));
+    }
+
+    static bool readLength(const std::string& data, size_t& pos, uint32_t& len) {
+        if (data.size() - pos < sizeof(len)) return false;
+        std::memcpy(&len, data.data() + pos, sizeof(len));
+        len = ntohl(len);
+        pos += sizeof(len);
+        return true;
+    }
+};
+
 }  // namespace kvcache
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "consistent_hash.h"
+#include "protocol.h"
+
+namespace kvcache {
+
+struct BackendRequest {
+    Command cmd;
+    std::string key;
+    std::vector<uint8_t> frame;
+    std::function<void(std::vector<uint8_t>)> on_reply;  // Raw reply frame, on the reader thread
+};
+
+// One pipelined connection to a backend server, shared by many client connections.
+// Servers answer a connection's requests in order, so replies are matched FIFO.
+class BackendConnection {
+public:
+    BackendConnection(const std::string& host, int port);
+    ~BackendConnection();
+
+    BackendConnection(const BackendConnection&) = delete;
+    BackendConnection& operator=(const BackendConnection&) = delete;
+
+    // Writes the whole batch with a single send. If the backend is unreachable
+    // every reply is an error frame instead, delivered before submit returns.
+    void submit(std::vector<BackendRequest>& batch);
+
+private:
+    std::string host_;
+    int port_;
+    int fd_;
+    std::thread reader_;
+    std::mutex write_mutex_;  // Serializes connect and send
+
+    std::mutex pending_mutex_;  // Protects pending_ and broken_
+    std::deque<BackendRequest> pending_;
+    bool broken_;
+
+    bool ensureConnected();
+    void readLoop(int fd);
+    void failPending();
+};
+
+// Routes protocol frames to backend servers by consistent hashing. Pipelined client
+// frames are dispatched together; MGET is split per backend and STATS fans out to all.
+class Proxy {
+public:
+    using Reply = std::function<void(const std::vector<uint8_t>&)>;
+
+    Proxy(const std::vector<std::string>& backends, size_t conns_per_backend = 2, size_t vnodes = 160);
+
+    // TcpServer async handler: consumes every complete frame in the buffer and calls reply
+    // with all of their replies, in order, from the reader thread of the last backend to answer
+    void handle(const std::vector<uint8_t>& data, size_t& consumed, Reply reply);
+
+private:
+    struct Slot;
+    struct Call;
+
+    struct Backend {
+        std::string addr;
+        std::vector<std::unique_ptr<BackendConnection>> conns;
+        std::atomic<size_t> next{0};
+    };
+
+    HashRing ring_;
+    std::vector<std::unique_ptr<Backend>> backends_;
+    std::unordered_map<std::string, Backend*> by_addr_;
+
+    Backend& route(const std::string& key);
+    std::vector<uint8_t> assemble(Call& call) const;
+};
+
+}  // namespace kvcache
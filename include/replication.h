@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "protocol.h"
+
+namespace kvcache {
+
+// Primary side of asynchronous replication.
+// Replicas connect to a dedicated port and send a SYNC frame. Each one receives a full
+// snapshot as SET frames, a SYNC marker carrying the stream offset, and then every frame
+// fed from the AOF tap. A PING frame (key: primary time in ms, value: offset) is sent when
+// the link is idle so replicas can report lag.
+//
+// Writes must be fed while their shard is locked, and the snapshot must call on_locked()
+// while holding every shard; the stream then starts exactly where the snapshot ends,
+// which matters for non-idempotent commands such as INCR and APPEND. Entries visited
+// after on_unlocked() (e.g. read from a flash tier) are sent as they come.
+class ReplicationPrimary {
+public:
+    using Visitor = std::function<void(const std::string&, const std::string&)>;
+    using SnapshotFn = std::function<void(const std::function<void()>& on_locked, const Visitor&,
+                                          const std::function<void()>& on_unlocked)>;
+
+    ReplicationPrimary(int port, SnapshotFn snapshot, int heartbeat_ms = 1000, size_t max_backlog = 1 << 20);
+    ~ReplicationPrimary();
+
+    void start();
+    void stop();
+
+    // Queue an encoded command frame for every connected replica
+    void feed(const std::vector<uint8_t>& frame);
+
+    size_t replicaCount();
+    uint64_t offset() const { return offset_; }
+
+private:
+    struct Replica {
+        int fd = -1;
+        uint64_t start_offset = 0;
+        std::thread sender;
+        std::mutex mutex;  // Protects queue, live and closed
+        std::condition_variable cv;
+        std::queue<std::vector<uint8_t>> queue;
+        bool live = false;  // Receives fed frames; set at the snapshot point
+        bool closed = false;
+    };
+
+    int port_;
+    int server_fd_;
+    int heartbeat_ms_;
+    size_t max_backlog_;  // Replicas falling further behind are dropped and must resync
+    SnapshotFn snapshot_;
+    std::atomic<bool> running_;
+    std::atomic<uint64_t> offset_;
+    std::thread accept_thread_;
+
+    std::mutex replicas_mutex_;
+    std::vector<std::shared_ptr<Replica>> replicas_;
+
+    void acceptLoop();
+    void serveReplica(std::shared_ptr<Replica> replica);
+};
+
+// Replica side: keeps a connection to the primary, performs a full sync on every
+// (re)connect and applies the streamed commands.
+class ReplicaClient {
+public:
+    using ApplyFn = std::function<void(Command, const std::string&, const std::string&)>;
+    using ResetFn = std::function<void()>;
+
+    struct Status {
+        bool connected = false;
+        bool synced = false;
+        uint64_t offset = 0;          // Last primary offset applied locally
+        uint64_t primary_offset = 0;  // Primary offset reported by the last PING
+        int64_t lag_ms = 0;           // Stream delay measured by the last PING
+        int64_t last_io_ms = 0;       // Time since anything was received from the primary
+    };
+
+    ReplicaClient(const std::string& host, int port, ApplyFn apply, ResetFn reset);
+    ~ReplicaClient();
+
+    void start();
+    void stop();
+    Status status() const;
+
+private:
+    std::string host_;
+    int port_;
+    ApplyFn apply_;
+    ResetFn reset_;
+    std::atomic<bool> running_;
+    std::atomic<int> fd_;
+    std::thread thread_;
+
+    std::atomic<bool> connected_;
+    std::atomic<bool> synced_;
+    std::atomic<uint64_t> offset_;
+    std::atomic<uint64_t> primary_offset_;
+    std::atomic<int64_t> lag_ms_;
+    std::atomic<int64_t> last_io_;
+
+    void syncLoop();
+    void runSession(int fd);
+};
+
+}  // namespace kvcache
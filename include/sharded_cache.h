@@ -1,29 +1,257 @@
 #pragma once
 
+#include <algorithm>
+#include <bit>
+#include <concepts>
 #include <functional>
 #include <memory>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
 
+#include "cache_loader.h"
+#include "hot_keys.h"
 #include "lru_cache.h"
 
 namespace kvcache {
 
-template <typename Key, typename Value, typename Hash = std::hash<Key>>
+// Routes each key to one of a power-of-two number of LRUCache shards by masking the
+// mixed hash. Eviction, lock and mixer policies are fixed at compile time (cache_policies.h).
+// Shard can be replaced by any type with LRUCache's interface (e.g. ShmShard).
+template <typename Key, typename Value, typename Hash = std::hash<Key>, typename Eviction = LruEviction,
+          typename Lock = std::mutex, typename Mixer = Murmur3Mixer,
+          typename ShardT = LRUCache<Key, Value, Eviction, Lock>>
 class ShardedCache {
 public:
-    ShardedCache(size_t capacity, size_t num_shards = 16) : num_shards_(num_shards), hash_() {
-        size_t capacity_per_shard = (capacity + num_shards - 1) / num_shards;
-        for (size_t i = 0; i < num_shards; ++i) {
-            shards_.emplace_back(std::make_unique<LRUCache<Key, Value>>(capacity_per_shard));
+    using Shard = ShardT;
+
+    // num_shards is rounded up to a power of two
+    ShardedCache(size_t capacity, size_t num_shards = 16)
+        : num_shards_(roundShards(num_shards)), mask_(num_shards_ - 1), hash_() {
+        size_t capacity_per_shard = (capacity + num_shards_ - 1) / num_shards_;
+        for (size_t i = 0; i < num_shards_; ++i) {
+            shards_.emplace_back(std::make_unique<Shard>(capacity_per_shard));
         }
     }
 
-    void put(const Key& key, const Value& value) { getShard(key).put(key, value); }
+    // Shards built by make_shard(index), for shards that are not constructed from a capacity
+    template <typename Factory>
+        requires std::invocable<Factory&, size_t>
+    ShardedCache(size_t num_shards, Factory&& make_shard)
+        : num_shards_(roundShards(num_shards)), mask_(num_shards_ - 1), hash_() {
+        for (size_t i = 0; i < num_shards_; ++i) {
+            shards_.emplace_back(make_shard(i));
+        }
+    }
+
+    static size_t roundShards(size_t num_shards) { return std::bit_ceil(std::max<size_t>(num_shards, 1)); }
+
+    // Identifies how keys are routed; persisted state keyed by shard must match it
+    static uint64_t routeFingerprint(const Key& probe, size_t num_shards) {
+        return Mixer::mix(Hash()(probe)) ^ roundShards(num_shards);
+    }
+
+    using HotKeys = HotKeyTracker<Key, Value, Hash>;
+
+    // Serve hot keys from per-thread copies (see HotKeyTracker). Call before sharing the cache.
+    void enableHotKeys(const typename HotKeys::Options& options = typename HotKeys::Options()) {
+        hot_ = std::make_unique<HotKeys>(options);
+    }
+    const HotKeys* hotKeys() const { return hot_.get(); }
+
+    using Loading = CacheLoader<Key, Value, Hash>;
+
+    // Read-through loading for getOrLoad() and friends (see CacheLoader). Call before
+    // sharing the cache.
+    void enableLoading(const typename Loading::Options& options = typename Loading::Options()) {
+        loading_ = std::make_unique<Loading>(options);
+    }
+    const Loading* loading() const { return loading_.get(); }
+
+    // Returns the cached value, or the one loader() finds (std::nullopt: not found). Concurrent
+    // misses on a key share a single loader call.
+    template <typename Loader>
+    std::optional<Value> getOrLoad(const Key& key, Loader&& loader) {
+        return requireLoading().getOrLoad(*this, key, std::forward<Loader>(loader));
+    }
+
+    template <typename Loader>
+    std::shared_future<std::optional<Value>> getOrLoadAsync(const Key& key, Loader loader) {
+        return requireLoading().getOrLoadAsync(*this, key, std::move(loader));
+    }
+
+    // loader(const std::vector<Key>& misses) returns one std::optional<Value> per miss
+    template <typename BatchLoader>
+    std::vector<std::optional<Value>> getAllOrLoad(const std::vector<Key>& keys, BatchLoader&& loader) {
+        return requireLoading().getAllOrLoad(*this, keys, std::forward<BatchLoader>(loader));
+    }
+
+    void put(const Key& key, const Value& value) {
+        getShard(key).put(key, value);
+        invalidateHot(key);
+    }
 
-    std::optional<Value> get(const Key& key) { return getShard(key).get(key); }
+    // Like put, calling on_put() inside the shard's critical section (e.g. to log the write).
+    // Unlike update, the old value is never read.
+    template <typename F>
+    void put(const Key& key, const Value& value, F&& on_put) {
+        putWith(getShard(key), key, value, on_put);
+        invalidateHot(key);
+    }
+
+    std::optional<Value> get(const Key& key) {
+        if (hot_) {
+            return hot_->get(key, [&]() { return getShard(key).get(key); });
+        }
+        return getShard(key).get(key);
+    }
 
     bool exists(const Key& key) { return getShard(key).exists(key); }
 
+    // False if the key's shard would not store an entry this large (see ShmShard::fits)
+    bool fits(const Key& key, const Value& value) {
+        Shard& shard = getShard(key);
+        if constexpr (requires { shard.fits(key, value); }) {
+            return shard.fits(key, value);
+        } else {
+            return true;
+        }
+    }
+
+    bool remove(const Key& key) {
+        bool removed = getShard(key).remove(key);
+        invalidateHot(key);
+        return removed;
+    }
+
+    template <typename F>
+    bool remove(const Key& key, F&& on_remove) {
+        bool removed = getShard(key).remove(key, std::forward<F>(on_remove));
+        invalidateHot(key);
+        return removed;
+    }
+
+    // See LRUCache::removeIf
+    template <typename P>
+    bool removeIf(const Key& key, P&& pred) {
+        bool removed = getShard(key).removeIf(key, std::forward<P>(pred));
+        invalidateHot(key);
+        return removed;
+    }
+
+    std::optional<std::pair<Value, uint64_t>> getVersioned(const Key& key) { return getShard(key).getVersioned(key); }
+
+    // Atomic read-modify-write within the key's shard, see LRUCache::update
+    template <typename F>
+    uint64_t update(const Key& key, F&& fn) {
+        uint64_t version = getShard(key).update(key, std::forward<F>(fn));
+        invalidateHot(key);
+        return version;
+    }
+
+    // Operations on one shard, see withShard()
+    template <typename Access>
+    class ShardBatch {
+    public:
+        ShardBatch(Access& access, HotKeys* hot) : access_(access), hot_(hot) {}
+
+        std::optional<Value> get(const Key& key) {
+            if (hot_) {
+                return hot_->get(key, [&]() { return access_.get(key); });
+            }
+            return access_.get(key);
+        }
+
+        template <typename F>
+        uint64_t update(const Key& key, F&& fn) {
+            uint64_t version = access_.update(key, std::forward<F>(fn));
+            if (hot_) hot_->invalidate(key);
+            return version;
+        }
+
+        template <typename F>
+        void put(const Key& key, const Value& value, F&& on_put) {
+            putWith(access_, key, value, on_put);
+            if (hot_) hot_->invalidate(key);
+        }
+
+        template <typename F>
+        bool remove(const Key& key, F&& on_remove) {
+            bool removed = access_.remove(key, std::forward<F>(on_remove));
+            if (hot_) hot_->invalidate(key);
+            return removed;
+        }
+
+        // A hint; a no-op for shards that cannot prefetch
+        void prefetch(const Key& key) {
+            if constexpr (requires { access_.prefetch(key); }) access_.prefetch(key);
+        }
+
+    private:
+        Access& access_;
+        HotKeys* hot_;
+    };
+
+    // Runs fn(batch) against shard index (see shardIndex()) holding its lock once, for callers
+    // that grouped their keys by shard. batch has the semantics of get/put/update/remove here;
+    // shards without withLock() lock per operation instead.
+    template <typename F>
+    void withShard(size_t index, F&& fn) {
+        Shard& shard = *shards_[index];
+        if constexpr (requires { shard.withLock([](auto&) {}); }) {
+            shard.withLock([&](auto& locked) {
+                ShardBatch<std::remove_reference_t<decltype(locked)>> batch(locked, hot_.get());
+                fn(batch);
+            });
+        } else {
+            ShardBatch<Shard> batch(shard, hot_.get());
+            fn(batch);
+        }
+    }
+
+    void clear() {
+        for (auto& shard : shards_) {
+            shard->clear();
+        }
+        if (hot_) hot_->invalidateAll();
+    }
+
+    // Visits shards one at a time; each shard is consistent but the whole view is not atomic
+    template <typename F>
+    void forEach(F&& fn) const {
+        for (const auto& shard : shards_) {
+            shard->forEach(fn);
+        }
+    }
+
+    // Visits every entry with all shards locked at once (always in index order), so the
+    // view is a single point in time. on_locked() runs once every shard is held and
+    // on_unlocked() once they are released. A flash tier is only located under the locks;
+    // its entries are read from disk and visited after on_unlocked().
+    template <typename G, typename F, typename U>
+    void snapshot(G&& on_locked, F&& visit, U&& on_unlocked) const {
+        std::vector<std::function<void()>> deferred;
+        {
+            std::vector<decltype(shards_.front()->acquire())> locks;
+            locks.reserve(shards_.size());
+            for (const auto& shard : shards_) {
+                locks.push_back(shard->acquire());
+            }
+            on_locked();
+            for (const auto& shard : shards_) {
+                if constexpr (requires { shard->forEachLockedDeferred(visit); }) {
+                    deferred.push_back(shard->forEachLockedDeferred(visit));
+                } else {
+                    shard->forEachLocked(visit);
+                }
+            }
+        }
+        on_unlocked();
+        for (auto& read : deferred) {
+            read();
+        }
+    }
+
     size_t size() const {
         size_t total = 0;
         for (const auto& shard : shards_) {
@@ -47,15 +275,42 @@ public:
         return total;
     }
 
+    size_t numShards() const { return num_shards_; }
+
+    size_t shardIndex(const Key& key) const { return Mixer::mix(hash_(key)) & mask_; }
+
 private:
-    LRUCache<Key, Value>& getShard(const Key& key) {
-        size_t hash_value = hash_(key);
-        return *shards_[hash_value % num_shards_];
+    // Shards without a put taking on_put write through update, ignoring the old value
+    template <typename Access, typename F>
+    static void putWith(Access& access, const Key& key, const Value& value, F& on_put) {
+        if constexpr (requires { access.put(key, value, on_put); }) {
+            access.put(key, value, on_put);
+        } else {
+            access.update(key, [&](const Value*, uint64_t) {
+                on_put();
+                return std::optional<Value>(value);
+            });
+        }
+    }
+
+    Shard& getShard(const Key& key) { return *shards_[shardIndex(key)]; }
+
+    Loading& requireLoading() {
+        if (!loading_) throw std::logic_error("getOrLoad() needs enableLoading()");
+        return *loading_;
+    }
+
+    // After the shard write, so no copy taken before it survives
+    void invalidateHot(const Key& key) {
+        if (hot_) hot_->invalidate(key);
     }
 
     size_t num_shards_;
-    std::vector<std::unique_ptr<LRUCache<Key, Value>>> shards_;
+    size_t mask_;
+    std::vector<std::unique_ptr<Shard>> shards_;
     Hash hash_;
+    std::unique_ptr<HotKeys> hot_;
+    std::unique_ptr<Loading> loading_;  // Last: its threads stop before the shards go away
 };
 
 }  // namespace kvcache
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <pthread.h>
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace kvcache {
+
+// A named POSIX shared-memory segment holding the cache shards, so a restarted (or
+// upgraded) server can attach to the previous process's data instead of rebuilding it.
+// Everything inside the segment links by offsets/indices, never by raw pointers, so it
+// can be mapped at any address. The segment survives the process until shm_unlink.
+class ShmRegion {
+public:
+    static constexpr uint32_t kLayoutVersion = 2;
+
+    struct Geometry {
+        uint32_t num_shards;
+        uint32_t capacity_per_shard;
+        uint32_t slot_bytes;         // Max key + value size per entry
+        uint64_t route_fingerprint;  // Detects a change in how keys map to shards
+    };
+
+    // Attaches if the segment exists with the same layout version and geometry,
+    // otherwise (re)initializes it. Throws std::runtime_error on system errors.
+    ShmRegion(const std::string& name, const Geometry& geometry);
+    ~ShmRegion();
+
+    ShmRegion(const ShmRegion&) = delete;
+    ShmRegion& operator=(const ShmRegion&) = delete;
+
+    // True when the previous contents were reused (warm start)
+    bool attached() const {
+        return attached_;
+    }
+    const Geometry& geometry() const {
+        return geometry_;
+    }
+    // Page aligned
+    void* shard(size_t index) const;
+    // Moves the shard's memory to a NUMA node (see bindMemory in numa.h)
+    bool bindShard(size_t index, int node);
+
+    static void unlink(const std::string& name);
+
+private:
+    std::string name_;
+    Geometry geometry_;
+    void* base_;
+    size_t size_;
+    size_t shard_offset_;  // Of the first shard; shards are page aligned
+    size_t shard_stride_;
+    bool attached_;
+};
+
+// One cache shard living inside a ShmRegion: a chained hash table and an LRU list over
+// fixed-size slots, guarded by a robust process-shared mutex. Same interface as
+// LRUCache<std::string, std::string> so ShardedCache can route to it. Entries larger
+// than the slot size are not cached.
+class ShmShard {
+public:
+    // Adapts the robust pthread mutex to Lockable. If the owner died mid-operation the
+    // shard is wiped rather than trusted (see recovered()).
+    class Mutex {
+    public:
+        explicit Mutex(ShmShard* shard) : shard_(shard) {
+        }
+        void lock();
+        void unlock();
+
+    private:
+        ShmShard* shard_;
+    };
+
+    ShmShard(ShmRegion& region, size_t index);
+
+    // Bytes one shard occupies in a region of the given geometry
+    static size_t bytesFor(const ShmRegion::Geometry& geometry);
+    // Initializes an empty shard in place (cold start)
+    static void format(ShmRegion& region, size_t index);
+
+    ShmShard(const ShmShard&) = delete;
+    ShmShard& operator=(const ShmShard&) = delete;
+
+    void put(const std::string& key, const std::string& value);
+    std::optional<std::string> get(const std::string& key);
+    std::optional<std::pair<std::string, uint64_t>> getVersioned(const std::string& key);
+    bool exists(const std::string& key);
+    bool remove(const std::string& key);
+    void clear();
+    size_t size() const;
+
+    // Whether an entry of this size can be stored; writes of larger ones store nothing
+    bool fits(const std::string& key, const std::string& value) const {
+        return capacity_ > 0 && key.size() + value.size() <= slot_bytes_;
+    }
+
+    // True if a previous process died holding the shard's lock, so the shard was wiped when
+    // it was attached. Its data has to be rebuilt from elsewhere (the AOF).
+    bool recovered() const {
+        return recovered_;
+    }
+
+    // See LRUCache::update
+    template <typename F>
+    uint64_t update(const std::string& key, F&& fn) {
+        std::lock_guard<Mutex> lock(mutex_);
+        uint64_t hash = hashKey(key);
+        uint32_t slot = findLocked(key, hash);
+        std::optional<std::string> value;
+        if (slot == kNil) {
+            value = fn(static_cast<const std::string*>(nullptr), uint64_t{0});
+        } else {
+            std::string current(valueLocked(slot));
+            value = fn(static_cast<const std::string*>(&current), versionLocked(slot));
+        }
+        if (!value) return 0;
+        return writeLocked(key, *value, hash, slot);
+    }
+
+    template <typename F>
+    bool remove(const std::string& key, F&& on_remove) {
+        std::lock_guard<Mutex> lock(mutex_);
+        uint32_t slot = findLocked(key, hashKey(key));
+        if (slot == kNil) return false;
+        on_remove();
+        eraseLocked(slot);
+        return true;
+    }
+
+    template <typename P>
+    bool removeIf(const std::string& key, P&& pred) {
+        std::lock_guard<Mutex> lock(mutex_);
+        uint32_t slot = findLocked(key, hashKey(key));
+        if (slot == kNil) return false;
+        std::string current(valueLocked(slot));
+        if (!pred(static_cast<const std::string&>(current), versionLocked(slot))) return false;
+        eraseLocked(slot);
+        return true;
+    }
+
+    template <typename F>
+    void forEach(F&& fn) const {
+        std::lock_guard<Mutex> lock(mutex_);
+        forEachLocked(fn);
+    }
+
+    std::unique_lock<Mutex> acquire() const {
+        return std::unique_lock<Mutex>(mutex_);
+    }
+
+    template <typename F>
+    void forEachLocked(F&& fn) const {
+        for (uint32_t slot = headLocked(); slot != kNil; slot = nextLocked(slot)) {
+            std::string key(keyLocked(slot));
+            std::string value(valueLocked(slot));
+            fn(key, value);
+        }
+    }
+
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+    };
+    Stats getStats() const;
+
+private:
+    static constexpr uint32_t kNil = UINT32_MAX;
+
+    struct Header;
+    struct Slot;
+
+    Header* header_;
+    char* slots_;
+    uint32_t* buckets_;
+    uint32_t slot_stride_;
+    uint32_t capacity_;
+    uint32_t slot_bytes_;
+    mutable Mutex mutex_;
+    bool recovered_ = false;
+
+    static uint64_t hashKey(std::string_view key);
+
+    Slot* slotAt(uint32_t index) const;
+    uint32_t findLocked(const std::string& key, uint64_t hash) const;
+    // Stores key/value into `slot` (or a new slot when kNil); returns the new version or 0 if too large
+    uint64_t writeLocked(const std::string& key, const std::string& value, uint64_t hash, uint32_t slot);
+    void eraseLocked(uint32_t slot);
+    void resetLocked();
+    std::string_view keyLocked(uint32_t slot) const;
+    std::string_view valueLocked(uint32_t slot) const;
+    uint64_t versionLocked(uint32_t slot) const;
+    uint32_t headLocked() const;
+    uint32_t nextLocked(uint32_t slot) const;
+    void touchLocked(uint32_t slot);
+};
+
+}  // namespace kvcache
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "protocol.h"
+
+namespace kvcache {
+
+// Blocking socket helpers shared by the replication link and the proxy's backend connections
+
+bool sendAll(int fd, const uint8_t* data, size_t len);
+bool readExact(int fd, void* out, size_t len);
+
+// Reads one protocol frame, undecoded (header + body)
+bool readRawFrame(int fd, std::vector<uint8_t>& frame);
+bool readFrame(int fd, Command& cmd, std::string& key, std::string& value);
+
+// Connects to host:port over IPv4; returns -1 on failure
+int connectTo(const std::string& host, int port);
+
+}  // namespace kvcache
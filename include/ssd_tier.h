@@ -0,0 +1,254 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "lru_cache.h"
+
+namespace kvcache {
+
+// Log-structured store for entries evicted from one shard. Records are appended to
+// fixed-size segment files; the in-memory index maps a key hash to the record's location.
+// Collisions are resolved on read (the record holds the key) and the older entry is lost.
+class TierLog {
+    struct Segment;
+
+public:
+    struct Location {
+        uint32_t segment;
+        uint32_t offset;
+        uint32_t size;  // Record bytes, header included
+    };
+
+    // Where the live records were at one moment. Records are never overwritten and each
+    // entry keeps its segment open, so reading them later still yields that moment's values.
+    using Records = std::vector<std::pair<Location, std::shared_ptr<Segment>>>;
+
+    struct Stats {
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> read_ns{0};  // Total time spent reading hits
+    };
+
+    TierLog(const std::string& path_prefix, size_t segment_bytes);
+    ~TierLog();
+
+    TierLog(const TierLog&) = delete;
+    TierLog& operator=(const TierLog&) = delete;
+
+    void put(const std::string& key, const std::string& value);
+
+    // lookup() counts a tier miss when the key is absent; find() counts nothing
+    std::optional<Location> lookup(const std::string& key);
+    std::optional<Location> find(const std::string& key) const;
+
+    // Reads the value at loc without holding the index lock. Returns std::nullopt if the
+    // record belongs to another key or its segment was reclaimed meanwhile.
+    std::optional<std::string> read(const std::string& key, const Location& loc);
+
+    bool erase(const std::string& key);
+    // Erases only if the key still lives at loc (not rewritten or relocated since)
+    bool eraseAt(const std::string& key, const Location& loc);
+    void clear();
+
+    // Reads every live record, e.g. for a snapshot
+    void forEach(const std::function<void(const std::string&, const std::string&)>& fn) const;
+
+    // The same in two steps: records() only takes the index lock, forEach() does the disk reads
+    Records records() const;
+    static void forEach(const Records& records,
+                        const std::function<void(const std::string&, const std::string&)>& fn);
+
+    size_t size() const;
+    uint64_t bytes() const;
+    const Stats& stats() const {
+        return stats_;
+    }
+
+    // One step of background reclamation: drops the oldest segment when over max_bytes,
+    // otherwise rewrites the sealed segment with the lowest live ratio if below
+    // min_live_ratio. Returns false when there was nothing to do.
+    bool reclaim(double min_live_ratio, uint64_t max_bytes);
+
+private:
+    struct Segment {
+        uint32_t id;
+        int fd;
+        std::string path;
+        uint64_t size = 0;
+        uint64_t live = 0;  // Bytes of records still referenced by the index
+        ~Segment();
+    };
+
+    std::string path_prefix_;
+    size_t segment_bytes_;
+    mutable std::mutex mutex_;  // Protects everything below
+    std::unordered_map<uint64_t, Location> index_;
+    std::map<uint32_t, std::shared_ptr<Segment>> segments_;  // Oldest first; the last is active
+    uint32_t next_segment_ = 0;
+    uint64_t bytes_ = 0;
+    Stats stats_;
+
+    static uint64_t hashKey(const std::string& key);
+    std::shared_ptr<Segment> openSegmentLocked();
+    void appendLocked(const std::string& key, const std::string& value);
+    void unindexLocked(const Location& loc);
+    std::shared_ptr<Segment> segmentFor(const Location& loc) const;
+};
+
+// The flash tier of a server: one TierLog per shard under a directory, reclaimed by a
+// background thread. Files are scratch space and are wiped on startup.
+class SsdTier {
+public:
+    struct Options {
+        size_t segment_bytes = 8 << 20;   // Per segment file
+        uint64_t max_bytes = 1ULL << 30;  // Across all shards
+        double min_live_ratio = 0.5;      // Sealed segments sparser than this are rewritten
+        int reclaim_interval_ms = 100;
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t read_ns = 0;
+        size_t entries = 0;
+        uint64_t bytes = 0;
+    };
+
+    SsdTier(const std::string& dir, size_t num_logs, const Options& options);
+    ~SsdTier();
+
+    TierLog& log(size_t index) {
+        return *logs_[index];
+    }
+    Stats stats() const;
+
+private:
+    Options options_;
+    std::vector<std::unique_ptr<TierLog>> logs_;
+    std::atomic<bool> running_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread reclaimer_;
+
+    void reclaimLoop();
+};
+
+// Shard whose evicted entries move to a TierLog instead of disappearing. A miss in memory
+// looks the key up in the tier and promotes a hit back into memory. A key is never in
+// both places: every write to a key first takes it out of the tier. Same interface as
+// LRUCache<std::string, std::string>.
+class TieredShard {
+public:
+    TieredShard(size_t capacity, TierLog& log);
+
+    TieredShard(const TieredShard&) = delete;
+    TieredShard& operator=(const TieredShard&) = delete;
+
+    void put(const std::string& key, const std::string& value);
+    std::optional<std::string> get(const std::string& key);
+    std::optional<std::pair<std::string, uint64_t>> getVersioned(const std::string& key);
+    bool exists(const std::string& key);
+    bool remove(const std::string& key);
+    void clear();
+    size_t size() const;
+
+    // See ShardedCache::put. A key living in the tier is dropped from it, not read.
+    template <typename F>
+    void put(const std::string& key, const std::string& value, F&& on_put) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        log_.erase(key);
+        on_put();
+        memory_.put(key, value);
+    }
+
+    // See LRUCache::update; a key living in the tier is promoted first so fn sees it
+    template <typename F>
+    uint64_t update(const std::string& key, F&& fn) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!memory_.exists(key)) {
+            promoteLocked(lock, key, false);
+        }
+        return memory_.update(key, std::forward<F>(fn));
+    }
+
+    template <typename F>
+    bool remove(const std::string& key, F&& on_remove) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (memory_.remove(key, on_remove)) return true;
+        if (!log_.erase(key)) return false;
+        on_remove();
+        return true;
+    }
+
+    // A key living in the tier is promoted first so pred sees its version
+    template <typename P>
+    bool removeIf(const std::string& key, P&& pred) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!memory_.exists(key)) {
+            promoteLocked(lock, key, false);
+        }
+        return memory_.removeIf(key, std::forward<P>(pred));
+    }
+
+    template <typename F>
+    void forEach(F&& fn) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        forEachLocked(fn);
+    }
+
+    std::unique_lock<std::mutex> acquire() const {
+        return std::unique_lock<std::mutex>(mutex_);
+    }
+
+    // Tier entries are read from disk
+    template <typename F>
+    void forEachLocked(F&& fn) const {
+        memory_.forEachLocked(fn);
+        log_.forEach([&fn](const std::string& key, const std::string& value) { fn(key, value); });
+    }
+
+    // Like forEachLocked, but the tier is only located: the returned function reads its
+    // entries, as of this call, once the lock has been released
+    template <typename F>
+    std::function<void()> forEachLockedDeferred(F fn) const {
+        memory_.forEachLocked(fn);
+        return [records = log_.records(), fn]() {
+            TierLog::forEach(records, [&fn](const std::string& key, const std::string& value) { fn(key, value); });
+        };
+    }
+
+    // Memory hits and misses; tier counters are in SsdTier::stats()
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+    };
+    Stats getStats() const;
+
+private:
+    // The memory part is guarded by mutex_
+    using Memory = LRUCache<std::string, std::string, LruEviction, NullLock>;
+
+    mutable std::mutex mutex_;
+    Memory memory_;
+    TierLog& log_;
+
+    // Called with the lock held and the key absent from memory. Moves the key up from the
+    // tier and returns its value and new version. The lock is released during the read.
+    // count_miss: the lookup serves a read, so an absent key is a tier miss.
+    std::optional<std::pair<std::string, uint64_t>> promoteLocked(std::unique_lock<std::mutex>& lock,
+                                                                  const std::string& key, bool count_miss = true);
+};
+
+}  // namespace kvcache
@@ -5,7 +5,9 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "thread_pool.h"
@@ -13,39 +15,130 @@
 namespace kvcache {
 
 struct Connection {
-    int fd;
+    int fd = -1;
     std::vector<uint8_t> read_buffer;
-    std::mutex mutex;  // Protect buffer
+    std::mutex mutex;        // Protect buffer, inflight and stalled
+    std::mutex write_mutex;  // Protects the fields below; keeps replies from interleaving
+    std::vector<uint8_t> pending;  // Reply bytes the socket has not taken yet
+    int write_fd = -1;             // dup of fd, polled for EPOLLOUT while pending is not empty
+    bool broken = false;           // A write failed; the connection is being dropped
+    size_t inflight = 0;     // Protocol v2 requests running on the pool, or awaiting an async reply
+    bool stalled = false;    // The buffer's next request waits for inflight to drain
+    size_t lane = 0;         // Serving lane, fixed at accept
+
+    // The fd stays open until in-flight requests holding the connection are done
+    ~Connection();
 };
 
 class TcpServer {
 public:
     // Handler takes raw bytes and returns response bytes
     // It also returns how many bytes were consumed. If 0, it means we need more
-    // data.
+    // data. It is called concurrently, also for requests of the same connection
+    // (protocol v2 frames without FLAG_ORDERED).
     using Handler = std::function<std::vector<uint8_t>(const std::vector<uint8_t>&, size_t&)>;
 
+    // Alternative to Handler for handlers that answer from their own threads, e.g. once a
+    // backend replies. Consumes bytes like Handler and, when it consumed any, calls Reply
+    // exactly once with the response, possibly before returning. No worker waits for the
+    // reply; the connection's later requests do.
+    using Reply = std::function<void(const std::vector<uint8_t>&)>;
+    using AsyncHandler = std::function<void(const std::vector<uint8_t>&, size_t&, Reply)>;
+
+    // Optional: takes the complete frames read from every connection that was ready in one
+    // epoll_wait round and returns one reply per frame. Each connection's frames are
+    // consecutive and in arrival order; starts holds the index of each one's first frame.
+    // Only v1 and FLAG_ORDERED v2 frames that Batchable accepts are batched. From the first
+    // other frame, a connection's frames go to the Handler on a pool task of their own, as
+    // do those of connections with v2 requests in flight, so a slow request holds up only
+    // its own connection.
+    using BatchHandler = std::function<std::vector<std::vector<uint8_t>>(const std::vector<std::vector<uint8_t>>&,
+                                                                         const std::vector<size_t>& starts)>;
+    using Batchable = std::function<bool(const std::vector<uint8_t>&)>;
+
+    // An event loop and a worker pool serving a share of the connections. With cpus set,
+    // the loop runs on cpus[0] and worker i on cpus[i % cpus.size()].
+    struct Lane {
+        int node = -1;          // NUMA node of cpus; new connections go to the lane of the
+                                // node their packets arrive on
+        std::vector<int> cpus;  // Empty: threads are not pinned
+        size_t workers = 4;
+    };
+
+    struct LaneStats {
+        int node;
+        std::vector<int> cpus;
+        size_t connections;
+        uint64_t accepted;
+    };
+
     TcpServer(int port, int thread_pool_size = 4);
+    TcpServer(int port, std::vector<Lane> lanes);
     ~TcpServer();
 
+    // Runs the first lane's event loop on the calling thread until stop()
     void start();
     void stop();
     void setHandler(Handler handler);
+    void setAsyncHandler(AsyncHandler handler);
+    void setBatchHandler(BatchHandler handler, Batchable batchable);
+
+    // A task and the index of the lane that should run it
+    using LaneTask = std::pair<size_t, std::function<void()>>;
+
+    // Runs every task once and returns when all have run. A task for the caller's own lane
+    // runs inline; the others go to a worker of their lane, e.g. to touch a shard's memory
+    // from its node. A task no worker picks up within a millisecond runs on the caller
+    // instead, so workers of two lanes waiting on each other cannot deadlock.
+    void runOnLanes(std::vector<LaneTask> tasks) const;
+
+    std::vector<LaneStats> laneStats() const;
+    // Threads whose pinning the kernel accepted
+    size_t pinnedThreads() const {
+        return pinned_threads_;
+    }
 
 private:
+    struct LaneState {
+        Lane config;
+        int epoll_fd = -1;
+        std::unique_ptr<ThreadPool> pool;
+        std::thread loop;  // Not used by the first lane
+        std::atomic<size_t> connections{0};
+        std::atomic<uint64_t> accepted{0};
+    };
+
     int port_;
     int server_fd_;
-    int epoll_fd_;
     std::atomic<bool> running_;
-    ThreadPool thread_pool_;
+    std::vector<std::unique_ptr<LaneState>> lanes_;
+    std::atomic<size_t> next_lane_{0};
+    std::atomic<size_t> pinned_threads_{0};
+    std::vector<int> cpu_nodes_;  // NUMA node of each CPU, for steering
     Handler handler_;
+    AsyncHandler async_handler_;
+    BatchHandler batch_handler_;
+    Batchable batchable_;
 
     std::mutex connections_mutex_;
     std::unordered_map<int, std::shared_ptr<Connection>> connections_;
 
-    void eventLoop();
+    void pin(const Lane& lane, size_t index);
+    size_t pickLane(int client_fd);
+    void eventLoop(LaneState& lane);
     void handleNewConnection();
-    void handleClientData(int client_fd);
+    void handleClientData(LaneState& lane, int client_fd);
+    void handleRound(LaneState& lane, std::vector<int> client_fds);
+    bool readAvailable(Connection& conn);
+    void rearm(LaneState& lane, int client_fd);
+    void processBuffer(const std::shared_ptr<Connection>& conn);
+    void runRequest(std::shared_ptr<Connection> conn, std::vector<uint8_t> frame);
+    void callAsync(const std::shared_ptr<Connection>& conn, const std::vector<uint8_t>& data, size_t& consumed);
+    void finishRequest(const std::shared_ptr<Connection>& conn);
+    void sendResponse(Connection& conn, const std::vector<uint8_t>& response);
+    void handleWritable(LaneState& lane, int client_fd);
+    void armWrite(Connection& conn);
+    void dropBroken(Connection& conn);
     void setNonBlocking(int fd);
     void removeConnection(int fd);
 };
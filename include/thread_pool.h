@@ -13,7 +13,8 @@ namespace kvcache {
 
 class ThreadPool {
 public:
-    explicit ThreadPool(size_t threads);
+    // on_start(i) runs first on worker i, e.g. to pin it to a CPU
+    explicit ThreadPool(size_t threads, std::function<void(size_t)> on_start = nullptr);
     ~ThreadPool();
 
     template <class F, class... Args>
@@ -30,9 +31,10 @@ private:
 
 // Implementation
 
-inline ThreadPool::ThreadPool(size_t threads) : stop_(false) {
+inline ThreadPool::ThreadPool(size_t threads, std::function<void(size_t)> on_start) : stop_(false) {
     for (size_t i = 0; i < threads; ++i)
-        workers_.emplace_back([this] {
+        workers_.emplace_back([this, i, on_start] {
+            if (on_start) on_start(i);
             for (;;) {
                 std::function<void()> task;
 
@@ -27,8 +27,15 @@ void AofLogger::stop() {
     }
 }
 
+void AofLogger::setTap(Tap tap) {
+    tap_ = std::move(tap);
+}
+
 void AofLogger::log(Command cmd, const std::string& key, const std::string& value) {
     auto data = Message::encode(cmd, key, value);
+    if (tap_) {
+        tap_(data);
+    }
     {
         std::lock_guard<std::mutex> lock(queue_mutex_);
         queue_.push(std::move(data));
@@ -0,0 +1,56 @@
+#include "backend.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+namespace kvcache {
+
+std::vector<std::optional<std::string>> Backend::loadMany(const std::vector<std::string>& keys) {
+    std::vector<std::optional<std::string>> values;
+    values.reserve(keys.size());
+    for (const auto& key : keys) {
+        values.push_back(load(key));
+    }
+    return values;
+}
+
+DirectoryBackend::DirectoryBackend(const std::string& dir) : dir_(dir) {
+    if (!std::filesystem::is_directory(dir_)) {
+        throw std::runtime_error("Backend directory " + dir_ + " does not exist");
+    }
+}
+
+std::optional<std::string> DirectoryBackend::load(const std::string& key) {
+    if (key.empty() || key == "." || key == ".." || key.find('/') != std::string::npos) {
+        return std::nullopt;
+    }
+
+    std::string path = dir_ + "/" + key;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT || errno == ENOTDIR) return std::nullopt;
+        throw std::runtime_error("Failed to open " + path + ": " + std::strerror(errno));
+    }
+
+    std::string value;
+    char buf[4096];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            int err = errno;
+            ::close(fd);
+            throw std::runtime_error("Failed to read " + path + ": " + std::strerror(err));
+        }
+        value.append(buf, n);
+    }
+    ::close(fd);
+    return value;
+}
+
+}  // namespace kvcache
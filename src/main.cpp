@@ -1,16 +1,210 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "aof.h"
+#include "backend.h"
+#include "numa.h"
 #include "protocol.h"
+#include "replication.h"
 #include "sharded_cache.h"
+#include "shm_cache.h"
+#include "ssd_tier.h"
 #include "tcp_server.h"
 
 using namespace kvcache;
 
-std::vector<uint8_t> handle_request(ShardedCache<std::string, std::string>& cache, AofLogger& aof,
-                                    const std::vector<uint8_t>& data, size_t& consumed) {
+// Where threads and shard memory go when started with --numa or --cpus
+struct Placement {
+    std::vector<TcpServer::Lane> lanes;
+    std::vector<int> shard_nodes;     // NUMA node owning each shard; empty without --numa
+    std::vector<size_t> shard_lanes;  // Index of that node's lane
+    bool shards_bound = false;        // Shard memory was moved to its node (--shm only)
+    bool shards_routed = false;       // Batched requests run on their shard's lane; heap entries
+                                      // inserted by them are allocated on its node, others are not
+};
+
+template <typename Cache>
+struct ServerContext {
+    Cache& cache;
+    AofLogger& aof;
+    ReplicationPrimary* primary = nullptr;  // Set when accepting replicas
+    ReplicaClient* replica = nullptr;       // Set when running as a read replica
+    SsdTier* tier = nullptr;                // Set when evictions spill to flash
+    Backend* backend = nullptr;             // Set when misses read through to a backend
+    const Placement* placement = nullptr;   // Set when threads are pinned
+    const TcpServer* server = nullptr;
+    std::atomic<uint64_t> shard_batches{0};  // Lock acquisitions by handle_batch
+    std::atomic<uint64_t> batched_ops{0};    // Requests they served
+};
+
+template <typename Cache>
+std::string replication_stats(const ServerContext<Cache>& ctx) {
+    if (ctx.replica) {
+        auto s = ctx.replica->status();
+        return ", Role: replica, Link: " + std::string(s.synced ? "up" : (s.connected ? "syncing" : "down")) +
+               ", Repl-Offset: " + std::to_string(s.offset) + ", Primary-Offset: " + std::to_string(s.primary_offset) +
+               ", Repl-Lag-Ms: " + std::to_string(s.lag_ms) + ", Last-IO-Ms: " + std::to_string(s.last_io_ms);
+    }
+    if (ctx.primary) {
+        return ", Role: primary, Replicas: " + std::to_string(ctx.primary->replicaCount()) +
+               ", Repl-Offset: " + std::to_string(ctx.primary->offset());
+    }
+    return "";
+}
+
+template <typename Cache>
+std::string hot_key_stats(const Cache& cache) {
+    auto* hot = cache.hotKeys();
+    if (!hot) return "";
+    std::string out = ", Hot-Keys: " + std::to_string(hot->hotKeys().size()) +
+                      ", Hot-Copy-Hits: " + std::to_string(hot->copyHits()) + ", Top-Keys:";
+    auto top = hot->topKeys();
+    for (size_t i = 0; i < top.size() && i < 5; ++i) {
+        out += " " + top[i].first + "=" + std::to_string(top[i].second);
+    }
+    return out;
+}
+
+template <typename Cache>
+std::string loader_stats(const Cache& cache) {
+    auto* loading = cache.loading();
+    if (!loading) return "";
+    const auto& s = loading->stats();
+    return ", Loads: " + std::to_string(s.loads.load()) + ", Load-Coalesced: " + std::to_string(s.coalesced.load()) +
+           ", Negative-Hits: " + std::to_string(s.negative_hits.load()) +
+           ", Load-Expired: " + std::to_string(s.expired.load()) + ", Refreshes: " + std::to_string(s.refreshes.load());
+}
+
+template <typename Cache>
+std::string batch_stats(const ServerContext<Cache>& ctx) {
+    uint64_t batches = ctx.shard_batches.load();
+    if (batches == 0) return "";
+    return ", Shard-Batches: " + std::to_string(batches) + ", Batched-Ops: " + std::to_string(ctx.batched_ops.load());
+}
+
+template <typename Cache>
+std::string numa_stats(const ServerContext<Cache>& ctx) {
+    if (!ctx.placement || !ctx.server) return "";
+    auto label = [](int node) { return node < 0 ? std::string("any") : "node" + std::to_string(node); };
+
+    std::string cpus = ", Numa-Cpus:", conns = ", Numa-Conns:";
+    for (const auto& lane : ctx.server->laneStats()) {
+        cpus += " " + label(lane.node) + "=" + formatRangeList(lane.cpus);
+        conns += " " + label(lane.node) + "=" + std::to_string(lane.connections);
+    }
+    std::string out = cpus + conns + ", Pinned-Threads: " + std::to_string(ctx.server->pinnedThreads());
+
+    // Heap shards are only routed: AOF replay, replication and unbatched requests insert
+    // from whichever thread runs them, so their placement is not reported as guaranteed
+    if (ctx.placement->shards_bound || ctx.placement->shards_routed) {
+        out += ctx.placement->shards_bound ? ", Numa-Shards:" : ", Numa-Routed-Shards:";
+        for (const auto& lane : ctx.placement->lanes) {
+            std::vector<int> shards;
+            for (size_t i = 0; i < ctx.placement->shard_nodes.size(); ++i) {
+                if (ctx.placement->shard_nodes[i] == lane.node) shards.push_back(static_cast<int>(i));
+            }
+            out += " " + label(lane.node) + "=" + formatRangeList(shards);
+        }
+    }
+    return out;
+}
+
+std::string tier_stats(const SsdTier* tier) {
+    if (!tier) return "";
+    auto s = tier->stats();
+    uint64_t lookups = s.hits + s.misses;
+    return ", Tier-Hits: " + std::to_string(s.hits) + ", Tier-Misses: " + std::to_string(s.misses) +
+           ", Tier-Hit-Rate: " + std::to_string(lookups ? s.hits * 100 / lookups : 0) + "%" +
+           ", Tier-Read-Ns: " + std::to_string(s.hits ? s.read_ns / s.hits : 0) +
+           ", Tier-Entries: " + std::to_string(s.entries) + ", Tier-Bytes: " + std::to_string(s.bytes);
+}
+
+using HeapCache = ShardedCache<std::string, std::string>;
+// Shards live in a named shared-memory segment and survive restarts
+using ShmCache =
+    ShardedCache<std::string, std::string, std::hash<std::string>, LruEviction, std::mutex, Murmur3Mixer, ShmShard>;
+// Evicted entries spill to an SSD tier
+using TieredCache =
+    ShardedCache<std::string, std::string, std::hash<std::string>, LruEviction, std::mutex, Murmur3Mixer, TieredShard>;
+
+bool parse_int64(const std::string& s, int64_t& out) {
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), out);
+    return ec == std::errc() && end == s.data() + s.size() && !s.empty();
+}
+
+// A missing key counts as 0; fails if the current value is not an integer or would overflow
+std::optional<std::string> increment(const std::string* current, int64_t delta) {
+    int64_t n = 0;
+    if (current && !parse_int64(*current, n)) return std::nullopt;
+    if (__builtin_add_overflow(n, delta, &n)) return std::nullopt;
+    return std::to_string(n);
+}
+
+const char* const kTooLarge = "ERR value too large";
+
+bool is_write(Command cmd) {
+    switch (cmd) {
+        case Command::SET:
+        case Command::DEL:
+        case Command::INCR:
+        case Command::DECR:
+        case Command::APPEND:
+        case Command::CAS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Applies a logged command, for AOF replay and the replication stream
+template <typename Cache>
+void apply_logged(Cache& cache, Command cmd, const std::string& key, const std::string& value) {
+    switch (cmd) {
+        case Command::SET:
+            cache.put(key, value);
+            break;
+        case Command::DEL:
+            cache.remove(key);
+            break;
+        case Command::INCR: {
+            int64_t delta;
+            if (!parse_int64(value, delta)) break;
+            cache.update(key, [delta](const std::string* current, uint64_t) { return increment(current, delta); });
+            break;
+        }
+        case Command::APPEND:
+            cache.update(key, [&value](const std::string* current, uint64_t) {
+                return std::optional<std::string>(current ? *current + value : value);
+            });
+            break;
+        default:
+            break;
+    }
+}
+
+// SET and DEL, shared by handle_request and handle_batch: target is the cache or a
+// ShardedCache::ShardBatch of the key's shard. The write is logged from inside the
+// shard's critical section. apply_set returns the reply value.
+template <typename Cache, typename Target>
+std::string apply_set(ServerContext<Cache>& ctx, Target& target, const std::string& key, const std::string& value) {
+    if (!ctx.cache.fits(key, value)) return kTooLarge;
+    target.put(key, value, [&]() { ctx.aof.log(Command::SET, key, value); });
+    return "";
+}
+
+template <typename Cache, typename Target>
+void apply_del(ServerContext<Cache>& ctx, Target& target, const std::string& key) {
+    target.remove(key, [&]() { ctx.aof.log(Command::DEL, key, ""); });
+}
+
+template <typename Cache>
+std::vector<uint8_t> handle_request(ServerContext<Cache>& ctx, const std::vector<uint8_t>& data, size_t& consumed) {
     if (data.size() < HEADER_SIZE) {
         consumed = 0;
         return {};
@@ -23,7 +217,14 @@ std::vector<uint8_t> handle_request(ShardedCache<std::string, std::string>& cach
         return {};
     }
 
-    size_t total_len = HEADER_SIZE + header.key_len + header.value_len;
+    if (header.version > MAX_VERSION) {
+        // The framing of a newer version is unknown, so the buffered bytes cannot be resynced
+        consumed = data.size();
+        return Message::encode(Command::UNKNOWN, "", "ERR unsupported protocol version");
+    }
+
+    size_t header_len = Message::headerSize(header);
+    size_t total_len = header_len + header.key_len + header.value_len;
     if (data.size() < total_len) {
         consumed = 0;
         return {};
@@ -31,73 +232,431 @@ std::vector<uint8_t> handle_request(ShardedCache<std::string, std::string>& cach
 
     consumed = total_len;
 
-    std::string key(reinterpret_cast<const char*>(data.data() + HEADER_SIZE), header.key_len);
+    std::string key(reinterpret_cast<const char*>(data.data() + header_len), header.key_len);
     std::string value;
     if (header.value_len > 0) {
-        value.assign(reinterpret_cast<const char*>(data.data() + HEADER_SIZE + header.key_len), header.value_len);
+        value.assign(reinterpret_cast<const char*>(data.data() + header_len + header.key_len), header.value_len);
     }
 
+    // Replies use the request's version; v2 replies echo the request ID
+    uint32_t request_id = header.version >= VERSION_2 ? Message::decodeExt(data.data()).request_id : 0;
+    auto reply = [&](Command reply_cmd, const std::string& reply_val) {
+        return header.version >= VERSION_2 ? Message::encodeV2(reply_cmd, key, reply_val, request_id)
+                                           : Message::encode(reply_cmd, key, reply_val);
+    };
+
     Command cmd = static_cast<Command>(header.command);
     std::string response_val;
     Command response_cmd = cmd;
 
+    auto& cache = ctx.cache;
+
+    // Replicas only change through the replication stream
+    if (ctx.replica && is_write(cmd)) {
+        return reply(response_cmd, "ERR read-only replica");
+    }
+
+    // Writes are logged from inside the shard's critical section, so the AOF and the
+    // replication stream see each key's writes in the order they were applied. A value
+    // the shard cannot hold (see fits()) is refused before anything is logged.
     switch (cmd) {
         case Command::SET:
-            cache.put(key, value);
-            aof.log(cmd, key, value);
+            response_val = apply_set(ctx, cache, key, value);
             break;
         case Command::GET: {
-            auto val = cache.get(key);
+            std::optional<std::string> val;
+            if (ctx.backend) {
+                try {
+                    val = cache.getOrLoad(key, [backend = ctx.backend, key]() { return backend->load(key); });
+                } catch (const std::exception& e) {
+                    response_val = std::string("ERR backend: ") + e.what();
+                    break;
+                }
+            } else {
+                val = cache.get(key);
+            }
             if (val) {
                 response_val = *val;
             }
             break;
         }
+        case Command::INCR:
+        case Command::DECR: {
+            int64_t delta = 1;
+            if (!value.empty() && !parse_int64(value, delta)) {
+                response_val = "ERR delta is not an integer";
+                break;
+            }
+            if (cmd == Command::DECR && __builtin_sub_overflow(int64_t{0}, delta, &delta)) {
+                response_val = "ERR delta out of range";
+                break;
+            }
+            cache.update(key, [&](const std::string* current, uint64_t) {
+                auto next = increment(current, delta);
+                if (!next) {
+                    response_val = "ERR value is not an integer or out of range";
+                    return next;
+                }
+                if (!cache.fits(key, *next)) {
+                    response_val = kTooLarge;
+                    return std::optional<std::string>();
+                }
+                // Logged as the delta, not the result; DECR is logged as a negative INCR
+                ctx.aof.log(Command::INCR, key, std::to_string(delta));
+                response_val = *next;
+                return next;
+            });
+            break;
+        }
+        case Command::APPEND:
+            cache.update(key, [&](const std::string* current, uint64_t) {
+                std::string next = current ? *current + value : value;
+                if (!cache.fits(key, next)) {
+                    response_val = kTooLarge;
+                    return std::optional<std::string>();
+                }
+                ctx.aof.log(cmd, key, value);  // Only the suffix is logged
+                response_val = std::to_string(next.size());
+                return std::optional<std::string>(std::move(next));
+            });
+            break;
+        case Command::GETS: {
+            auto val = cache.getVersioned(key);
+            if (val) {
+                response_val = std::to_string(val->second) + " " + val->first;
+            }
+            break;
+        }
+        case Command::CAS: {
+            auto space = value.find(' ');
+            uint64_t expected = 0;
+            if (space == std::string::npos ||
+                std::from_chars(value.data(), value.data() + space, expected).ptr != value.data() + space) {
+                response_val = "ERR malformed CAS";
+                break;
+            }
+            std::string desired = value.substr(space + 1);
+
+            bool found = false;
+            uint64_t version = cache.update(key, [&](const std::string* current, uint64_t current_version) {
+                found = current != nullptr;
+                if (!found || current_version != expected) return std::optional<std::string>();
+                if (!cache.fits(key, desired)) {
+                    response_val = kTooLarge;
+                    return std::optional<std::string>();
+                }
+                ctx.aof.log(Command::SET, key, desired);
+                return std::optional<std::string>(desired);
+            });
+            if (response_val.empty()) {
+                response_val = version ? std::to_string(version) : (found ? "EXISTS" : "NOT_FOUND");
+            }
+            break;
+        }
+        case Command::MGET: {
+            std::vector<std::string> keys;
+            if (!MultiKey::unpackKeys(value, keys)) {
+                response_val = "ERR malformed MGET";
+                break;
+            }
+            std::vector<std::optional<std::string>> values;
+            if (ctx.backend) {
+                try {
+                    values = cache.getAllOrLoad(keys, [backend = ctx.backend](const std::vector<std::string>& misses) {
+                        return backend->loadMany(misses);
+                    });
+                } catch (const std::exception& e) {
+                    response_val = std::string("ERR backend: ") + e.what();
+                    break;
+                }
+            } else {
+                values.reserve(keys.size());
+                for (const auto& k : keys) {
+                    values.push_back(cache.get(k));
+                }
+            }
+            response_val = MultiKey::packValues(values);
+            break;
+        }
         case Command::DEL:
-            // cache.remove(key);
-            // aof.log(cmd, key, "");
+            apply_del(ctx, cache, key);
             break;
         case Command::STATS: {
             auto stats = cache.getStats();
             response_val = "Hits: " + std::to_string(stats.hits) + ", Misses: " + std::to_string(stats.misses);
+            response_val += replication_stats(ctx);
+            response_val += tier_stats(ctx.tier);
+            response_val += hot_key_stats(cache);
+            response_val += loader_stats(cache);
+            response_val += numa_stats(ctx);
+            response_val += batch_stats(ctx);
             break;
         }
+        case Command::PING:
+            response_val = std::to_string(MAX_VERSION);
+            break;
         default:
             break;
     }
 
-    return Message::encode(response_cmd, key, response_val);
+    return reply(response_cmd, response_val);
 }
 
-int main(int argc, char** argv) {
+// Whether a frame is cheap enough to run inside an event-loop round: GET, SET and DEL,
+// except GETs that may read through to the backend and writes a replica refuses. The
+// rest of the connection's frames run through handle_request on a task of their own.
+template <typename Cache>
+bool batchable(const ServerContext<Cache>& ctx, const std::vector<uint8_t>& frame) {
+    Command cmd = static_cast<Command>(Message::decodeHeader(frame.data()).command);
+    return (cmd == Command::SET || cmd == Command::DEL || (cmd == Command::GET && !ctx.backend)) &&
+           !(ctx.replica && is_write(cmd));
+}
+
+// Executes the batchable frames of one event-loop round. They are grouped by shard and
+// each group runs under a single lock acquisition, its buckets prefetched first. The
+// groups run in waves, and in each wave a connection adds only the requests at the front
+// of its queue that share one shard. So every connection's requests, and the AOF and
+// replication stream, take effect in the order they were sent, across shards too.
+template <typename Cache>
+std::vector<std::vector<uint8_t>> handle_batch(ServerContext<Cache>& ctx,
+                                               const std::vector<std::vector<uint8_t>>& frames,
+                                               const std::vector<size_t>& starts) {
+    struct Op {
+        size_t frame;
+        Command cmd;
+        uint8_t version;
+        uint32_t request_id;
+        std::string key;
+        std::string value;
+    };
+
+    auto& cache = ctx.cache;
+    std::vector<std::vector<uint8_t>> replies(frames.size());
+    std::vector<std::vector<Op>> groups(cache.numShards());
+
+    auto run_group = [&](size_t shard) {
+        auto& group = groups[shard];
+        cache.withShard(shard, [&](auto& batch) {
+            for (const auto& op : group) {
+                batch.prefetch(op.key);
+            }
+            for (const auto& op : group) {
+                std::string response_val;
+                switch (op.cmd) {
+                    case Command::SET:
+                        response_val = apply_set(ctx, batch, op.key, op.value);
+                        break;
+                    case Command::GET:
+                        if (auto val = batch.get(op.key)) response_val = std::move(*val);
+                        break;
+                    default:
+                        apply_del(ctx, batch, op.key);
+                        break;
+                }
+                replies[op.frame] = op.version >= VERSION_2
+                                        ? Message::encodeV2(op.cmd, op.key, response_val, op.request_id)
+                                        : Message::encode(op.cmd, op.key, response_val);
+            }
+        });
+        ctx.shard_batches++;
+        ctx.batched_ops += group.size();
+        group.clear();
+    };
+
+    std::vector<Op> ops;
+    std::vector<size_t> shards;
+    ops.reserve(frames.size());
+    shards.reserve(frames.size());
+    for (size_t i = 0; i < frames.size(); ++i) {
+        const auto& frame = frames[i];
+        Header header = Message::decodeHeader(frame.data());
+        size_t header_len = Message::headerSize(header);
+        uint32_t request_id = header.version >= VERSION_2 ? Message::decodeExt(frame.data()).request_id : 0;
+        std::string key(reinterpret_cast<const char*>(frame.data() + header_len), header.key_len);
+        std::string value(reinterpret_cast<const char*>(frame.data() + header_len + header.key_len),
+                          header.value_len);
+        shards.push_back(cache.shardIndex(key));
+        ops.push_back(Op{i, static_cast<Command>(header.command), header.version, request_id, std::move(key),
+                         std::move(value)});
+    }
+
+    // With lanes on several nodes each shard's group runs on its node (see Placement)
+    bool route = ctx.placement && ctx.placement->shards_routed && ctx.placement->lanes.size() > 1;
+    std::vector<size_t> next(starts);  // Each connection's first request not run yet
+    bool pending = true;
+    while (pending) {
+        pending = false;
+        for (size_t c = 0; c < next.size(); ++c) {
+            size_t end = c + 1 < starts.size() ? starts[c + 1] : frames.size();
+            size_t i = next[c];
+            if (i == end) continue;
+            size_t shard = shards[i];
+            for (; i < end && shards[i] == shard; ++i) {
+                groups[shard].push_back(std::move(ops[i]));
+            }
+            next[c] = i;
+            pending |= i < end;
+        }
+
+        std::vector<TcpServer::LaneTask> tasks;
+        for (size_t shard = 0; shard < groups.size(); ++shard) {
+            if (groups[shard].empty()) continue;
+            if (route) {
+                tasks.emplace_back(ctx.placement->shard_lanes[shard], [&run_group, shard]() { run_group(shard); });
+            } else {
+                run_group(shard);
+            }
+        }
+        if (!tasks.empty()) ctx.server->runOnLanes(std::move(tasks));
+    }
+    return replies;
+}
+
+void usage(const char* prog) {
+    std::cerr << "Usage: " << prog
+              << " [port] [--repl-port <port>] [--replica-of <host:port>] [--shm <name>] [--shm-slot-bytes <n>]"
+                 " [--ssd-tier <dir>] [--ssd-tier-mb <n>] [--no-hot-keys]"
+                 " [--backend-dir <dir>] [--backend-ttl-ms <n>] [--backend-negative-ttl-ms <n>]"
+                 " [--backend-refresh-ahead <fraction>] [--numa] [--cpus <list>] [--no-batching]"
+              << std::endl;
+}
+
+struct Options {
     int port = 8080;
-    if (argc > 1) {
-        port = std::stoi(argv[1]);
+    int repl_port = 0;
+    std::string primary_host;
+    int primary_port = 0;
+    std::string shm_name;
+    size_t shm_slot_bytes = 1024;
+    std::string tier_dir;
+    uint64_t tier_mb = 1024;
+    bool hot_keys = true;
+    std::string backend_dir;
+    int64_t backend_ttl_ms = 0;  // 0: loaded entries stay until evicted or overwritten
+    int64_t backend_negative_ttl_ms = 1000;
+    double backend_refresh_ahead = 0;
+    bool numa = false;
+    std::vector<int> cpus;  // Empty: every CPU the process may use
+    bool batching = true;   // Group each event-loop round's requests by shard
+};
+
+constexpr size_t kCapacity = 1000;
+constexpr size_t kShards = 16;
+
+// With --numa: one lane per node with a worker per CPU, and shards split into contiguous
+// blocks per node. Otherwise one lane whose threads are spread over the CPUs.
+Placement make_placement(const Options& opts, size_t num_shards) {
+    auto topology = NumaTopology::detect().restrictTo(opts.cpus.empty() ? NumaTopology::allowedCpus() : opts.cpus);
+    if (topology.nodes().empty()) {
+        throw std::runtime_error("None of the CPUs in --cpus is online");
     }
 
-    std::cout << "Initializing Sharded Cache..." << std::endl;
-    ShardedCache<std::string, std::string> cache(1000, 16);
+    Placement placement;
+    if (opts.numa) {
+        for (const auto& node : topology.nodes()) {
+            placement.lanes.push_back(TcpServer::Lane{node.id, node.cpus, node.cpus.size()});
+        }
+        for (size_t i = 0; i < num_shards; ++i) {
+            size_t lane = i * placement.lanes.size() / num_shards;
+            placement.shard_lanes.push_back(lane);
+            placement.shard_nodes.push_back(placement.lanes[lane].node);
+        }
+        placement.shards_routed = opts.batching;
+    } else {
+        TcpServer::Lane lane;
+        for (const auto& node : topology.nodes()) {
+            lane.cpus.insert(lane.cpus.end(), node.cpus.begin(), node.cpus.end());
+        }
+        placement.lanes.push_back(std::move(lane));
+    }
+    return placement;
+}
 
+// Optional parts main() sets up around the cache
+struct Attachments {
+    SsdTier* tier = nullptr;
+    Backend* backend = nullptr;
+    const Placement* placement = nullptr;
+    std::vector<bool> recovered_shards;  // Wiped on a warm start; rebuilt from the AOF
+};
+
+// warm: the cache already holds the previous process's data, so the AOF is not replayed
+template <typename Cache>
+int serve(Cache& cache, const Options& opts, bool warm, const Attachments& attachments = Attachments()) {
     std::cout << "Initializing AOF..." << std::endl;
     AofLogger aof("appendonly.aof");
+    ServerContext<Cache> ctx{cache, aof};
+    ctx.tier = attachments.tier;
+    ctx.backend = attachments.backend;
+    ctx.placement = attachments.placement;
 
-    std::cout << "Replaying AOF..." << std::endl;
-    aof.replay([&cache](Command cmd, const std::string& key, const std::string& value) {
-        if (cmd == Command::SET) {
-            cache.put(key, value);
-        } else if (cmd == Command::DEL) {
-            // cache.remove(key);
+    if (opts.hot_keys) {
+        cache.enableHotKeys();
+    }
+    if (ctx.backend) {
+        typename Cache::Loading::Options loading;
+        loading.ttl = std::chrono::milliseconds(opts.backend_ttl_ms);
+        loading.negative_ttl = std::chrono::milliseconds(opts.backend_negative_ttl_ms);
+        loading.refresh_ahead = opts.backend_refresh_ahead;
+        cache.enableLoading(loading);
+    }
+
+    std::unique_ptr<ReplicaClient> replica;
+    std::unique_ptr<ReplicationPrimary> primary;
+
+    if (!opts.primary_host.empty()) {
+        // A replica's state comes entirely from the primary's full sync, so its own AOF is not replayed
+        std::cout << "Replicating from " << opts.primary_host << ":" << opts.primary_port << "..." << std::endl;
+        replica = std::make_unique<ReplicaClient>(
+            opts.primary_host, opts.primary_port,
+            [&cache](Command cmd, const std::string& key, const std::string& value) {
+                apply_logged(cache, cmd, key, value);
+            },
+            [&cache]() { cache.clear(); });
+        ctx.replica = replica.get();
+        replica->start();
+    } else {
+        const auto& recovered = attachments.recovered_shards;
+        if (warm && std::find(recovered.begin(), recovered.end(), true) != recovered.end()) {
+            std::cout << "Warm start: replaying the AOF into shards lost with the previous process..." << std::endl;
+            aof.replay([&cache, &recovered](Command cmd, const std::string& key, const std::string& value) {
+                if (recovered[cache.shardIndex(key)]) apply_logged(cache, cmd, key, value);
+            });
+        } else if (warm) {
+            std::cout << "Warm start: " << cache.size() << " entries reused, skipping AOF replay" << std::endl;
+        } else {
+            std::cout << "Replaying AOF..." << std::endl;
+            aof.replay([&cache](Command cmd, const std::string& key, const std::string& value) {
+                apply_logged(cache, cmd, key, value);
+            });
         }
-    });
+
+        if (opts.repl_port > 0) {
+            primary = std::make_unique<ReplicationPrimary>(
+                opts.repl_port,
+                [&cache](const std::function<void()>& on_locked, const ReplicationPrimary::Visitor& visit,
+                         const std::function<void()>& on_unlocked) { cache.snapshot(on_locked, visit, on_unlocked); });
+            aof.setTap([&primary](const std::vector<uint8_t>& frame) { primary->feed(frame); });
+            ctx.primary = primary.get();
+            primary->start();
+        }
+    }
 
     aof.start();
 
-    std::cout << "Starting Server on port " << port << "..." << std::endl;
-    TcpServer server(port);
+    std::cout << "Starting Server on port " << opts.port << "..." << std::endl;
+    TcpServer server(opts.port, ctx.placement ? ctx.placement->lanes : std::vector<TcpServer::Lane>{TcpServer::Lane()});
+    ctx.server = &server;
 
-    server.setHandler([&cache, &aof](const std::vector<uint8_t>& data, size_t& consumed) {
-        return handle_request(cache, aof, data, consumed);
-    });
+    server.setHandler(
+        [&ctx](const std::vector<uint8_t>& data, size_t& consumed) { return handle_request(ctx, data, consumed); });
+    if (opts.batching) {
+        server.setBatchHandler(
+            [&ctx](const std::vector<std::vector<uint8_t>>& frames, const std::vector<size_t>& starts) {
+                return handle_batch(ctx, frames, starts);
+            },
+            [&ctx](const std::vector<uint8_t>& frame) { return batchable(ctx, frame); });
+    }
 
     try {
         server.start();
@@ -108,3 +667,149 @@ int main(int argc, char** argv) {
 
     return 0;
 }
+
+int main(int argc, char** argv) {
+    Options opts;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--repl-port" && i + 1 < argc) {
+            opts.repl_port = std::stoi(argv[++i]);
+        } else if (arg == "--replica-of" && i + 1 < argc) {
+            std::string addr = argv[++i];
+            auto colon = addr.rfind(':');
+            if (colon == std::string::npos) {
+                usage(argv[0]);
+                return 1;
+            }
+            opts.primary_host = addr.substr(0, colon);
+            opts.primary_port = std::stoi(addr.substr(colon + 1));
+        } else if (arg == "--shm" && i + 1 < argc) {
+            opts.shm_name = argv[++i];
+        } else if (arg == "--shm-slot-bytes" && i + 1 < argc) {
+            opts.shm_slot_bytes = std::stoul(argv[++i]);
+        } else if (arg == "--ssd-tier" && i + 1 < argc) {
+            opts.tier_dir = argv[++i];
+        } else if (arg == "--ssd-tier-mb" && i + 1 < argc) {
+            opts.tier_mb = std::stoull(argv[++i]);
+        } else if (arg == "--no-hot-keys") {
+            opts.hot_keys = false;
+        } else if (arg == "--backend-dir" && i + 1 < argc) {
+            opts.backend_dir = argv[++i];
+        } else if (arg == "--backend-ttl-ms" && i + 1 < argc) {
+            opts.backend_ttl_ms = std::stoll(argv[++i]);
+        } else if (arg == "--backend-negative-ttl-ms" && i + 1 < argc) {
+            opts.backend_negative_ttl_ms = std::stoll(argv[++i]);
+        } else if (arg == "--backend-refresh-ahead" && i + 1 < argc) {
+            opts.backend_refresh_ahead = std::stod(argv[++i]);
+        } else if (arg == "--numa") {
+            opts.numa = true;
+        } else if (arg == "--cpus" && i + 1 < argc) {
+            try {
+                opts.cpus = parseRangeList(argv[++i]);
+            } catch (const std::invalid_argument& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+        } else if (arg == "--no-batching") {
+            opts.batching = false;
+        } else if (!arg.empty() && arg[0] != '-') {
+            opts.port = std::stoi(arg);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!opts.shm_name.empty() && !opts.tier_dir.empty()) {
+        std::cerr << "--shm and --ssd-tier cannot be combined" << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<Backend> backend;
+    if (!opts.backend_dir.empty()) {
+        try {
+            backend = std::make_unique<DirectoryBackend>(opts.backend_dir);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "Reading misses through from " << opts.backend_dir << std::endl;
+    }
+
+    std::unique_ptr<Placement> placement;
+    if (opts.numa || !opts.cpus.empty()) {
+        try {
+            placement = std::make_unique<Placement>(make_placement(opts, HeapCache::roundShards(kShards)));
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        for (const auto& lane : placement->lanes) {
+            std::cout << "Lane on " << (lane.node < 0 ? std::string("any node") : "node " + std::to_string(lane.node))
+                      << ": CPUs " << formatRangeList(lane.cpus) << ", " << lane.workers << " workers" << std::endl;
+        }
+        if (opts.numa && placement->shards_routed) {
+            std::cout << "Batched SET/GET/DEL run on their shard's node" << std::endl;
+        } else if (opts.numa && opts.shm_name.empty()) {
+            // Heap entries are allocated by whichever thread inserts them
+            std::cout << "Shard memory follows the inserting thread's node; use --shm to place shards" << std::endl;
+        }
+    }
+
+    std::cout << "Initializing Sharded Cache..." << std::endl;
+    if (!opts.tier_dir.empty()) {
+        size_t num_shards = TieredCache::roundShards(kShards);
+        SsdTier::Options tier_options;
+        tier_options.max_bytes = opts.tier_mb << 20;
+        try {
+            SsdTier tier(opts.tier_dir, num_shards, tier_options);
+            std::cout << "SSD tier at " << opts.tier_dir << " (" << opts.tier_mb << " MB)" << std::endl;
+            TieredCache cache(num_shards, [&tier, num_shards](size_t i) {
+                return std::make_unique<TieredShard>((kCapacity + num_shards - 1) / num_shards, tier.log(i));
+            });
+            return serve(cache, opts, false, Attachments{&tier, backend.get(), placement.get(), {}});
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    if (opts.shm_name.empty()) {
+        HeapCache cache(kCapacity, kShards);
+        return serve(cache, opts, false, Attachments{nullptr, backend.get(), placement.get(), {}});
+    }
+
+    size_t num_shards = ShmCache::roundShards(kShards);
+    ShmRegion::Geometry geometry{static_cast<uint32_t>(num_shards),
+                                 static_cast<uint32_t>((kCapacity + num_shards - 1) / num_shards),
+                                 static_cast<uint32_t>(opts.shm_slot_bytes), 0};
+    geometry.route_fingerprint = ShmCache::routeFingerprint("kvcache", num_shards);
+
+    try {
+        ShmRegion region(opts.shm_name, geometry);
+        std::cout << (region.attached() ? "Attached to" : "Created") << " shared memory segment " << opts.shm_name
+                  << std::endl;
+        if (placement && !placement->shard_nodes.empty()) {
+            size_t bound = 0;
+            for (size_t i = 0; i < num_shards; ++i) {
+                bound += region.bindShard(i, placement->shard_nodes[i]);
+            }
+            placement->shards_bound = bound == num_shards;
+            if (!placement->shards_bound) {
+                std::cerr << "Warning: could not move " << num_shards - bound << " shards to their NUMA node"
+                          << std::endl;
+            }
+        }
+        std::vector<bool> recovered(num_shards, false);
+        ShmCache cache(num_shards, [&region, &recovered](size_t i) {
+            auto shard = std::make_unique<ShmShard>(region, i);
+            recovered[i] = shard->recovered();
+            return shard;
+        });
+        return serve(cache, opts, region.attached(),
+                     Attachments{nullptr, backend.get(), placement.get(), std::move(recovered)});
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,167 @@
+#include "numa.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+namespace kvcache {
+
+namespace {
+
+// From linux/mempolicy.h, which libc does not ship
+constexpr int kMpolPreferred = 1;
+constexpr unsigned kMpolMfMove = 1 << 1;
+
+std::string readLine(const std::filesystem::path& path) {
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+}  // namespace
+
+NumaTopology::NumaTopology(std::vector<Node> nodes) : nodes_(std::move(nodes)) {}
+
+std::vector<int> NumaTopology::allowedCpus() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    std::vector<int> cpus;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+    }
+    if (cpus.empty()) {
+        for (unsigned cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); ++cpu) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    return cpus;
+}
+
+NumaTopology NumaTopology::detect() {
+    std::vector<Node> nodes;
+
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", ec)) {
+        std::string name = entry.path().filename();
+        if (name.rfind("node", 0) != 0 || name.size() == 4 ||
+            !std::all_of(name.begin() + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            continue;
+        }
+        std::vector<int> cpus;
+        try {
+            cpus = parseRangeList(readLine(entry.path() / "cpulist"));
+        } catch (const std::invalid_argument&) {
+            continue;
+        }
+        if (cpus.empty()) continue;  // Memory-only node
+        nodes.push_back(Node{std::stoi(name.substr(4)), std::move(cpus)});
+    }
+
+    if (nodes.empty()) {
+        nodes.push_back(Node{0, allowedCpus()});
+    }
+    std::sort(nodes.begin(), nodes.end(), [](const Node& a, const Node& b) { return a.id < b.id; });
+    return NumaTopology(std::move(nodes));
+}
+
+int NumaTopology::nodeOf(int cpu) const {
+    for (const auto& node : nodes_) {
+        if (std::find(node.cpus.begin(), node.cpus.end(), cpu) != node.cpus.end()) return node.id;
+    }
+    return -1;
+}
+
+NumaTopology NumaTopology::restrictTo(const std::vector<int>& cpus) const {
+    std::vector<Node> kept;
+    for (const auto& node : nodes_) {
+        Node n{node.id, {}};
+        for (int cpu : node.cpus) {
+            if (std::find(cpus.begin(), cpus.end(), cpu) != cpus.end()) n.cpus.push_back(cpu);
+        }
+        if (!n.cpus.empty()) kept.push_back(std::move(n));
+    }
+    return NumaTopology(std::move(kept));
+}
+
+std::vector<int> parseRangeList(const std::string& list) {
+    std::vector<int> ids;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos) end = list.size();
+        std::string item = list.substr(pos, end - pos);
+        pos = end + 1;
+
+        size_t dash = item.find('-');
+        size_t used_first = 0, used_last = 0;
+        int first, last;
+        try {
+            first = std::stoi(item.substr(0, dash), &used_first);
+            last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1), &used_last);
+        } catch (const std::exception&) {
+            throw std::invalid_argument("Malformed list: " + list);
+        }
+        bool complete = used_first == (dash == std::string::npos ? item.size() : dash) &&
+                        (dash == std::string::npos || used_last == item.size() - dash - 1);
+        if (!complete || first < 0 || last < first) {
+            throw std::invalid_argument("Malformed list: " + list);
+        }
+        for (int id = first; id <= last; ++id) {
+            ids.push_back(id);
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+std::string formatRangeList(std::vector<int> ids) {
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    std::string out;
+    for (size_t i = 0; i < ids.size();) {
+        size_t j = i;
+        while (j + 1 < ids.size() && ids[j + 1] == ids[j] + 1) ++j;
+        if (!out.empty()) out += ",";
+        out += std::to_string(ids[i]);
+        if (j > i) out += "-" + std::to_string(ids[j]);
+        i = j + 1;
+    }
+    return out;
+}
+
+bool pinThread(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+bool bindMemory(void* addr, size_t len, int node) {
+    if (node < 0) return false;
+    uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t start = (reinterpret_cast<uintptr_t>(addr) + page - 1) & ~(page - 1);
+    uintptr_t end = (reinterpret_cast<uintptr_t>(addr) + len) & ~(page - 1);
+    if (end <= start) return true;  // No whole page to bind
+
+    constexpr size_t kBits = sizeof(unsigned long) * 8;
+    std::vector<unsigned long> mask(node / kBits + 1, 0);
+    mask[node / kBits] |= 1UL << (node % kBits);
+    // The kernel reads maxnode - 1 bits
+    return syscall(SYS_mbind, start, end - start, kMpolPreferred, mask.data(), mask.size() * kBits + 1,
+                   kMpolMfMove) == 0;
+}
+
+}  // namespace kvcache
@@ -0,0 +1,336 @@
+#include "proxy.h"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include "socket_io.h"
+
+namespace kvcache {
+
+namespace {
+
+std::string replyValue(const std::vector<uint8_t>& frame) {
+    Header header = Message::decodeHeader(frame.data());
+    return std::string(reinterpret_cast<const char*>(frame.data() + HEADER_SIZE + header.key_len), header.value_len);
+}
+
+}  // namespace
+
+// ---------------------------------------------------------------------------
+// BackendConnection
+// ---------------------------------------------------------------------------
+
+BackendConnection::BackendConnection(const std::string& host, int port)
+    : host_(host), port_(port), fd_(-1), broken_(false) {
+}
+
+BackendConnection::~BackendConnection() {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    if (fd_ != -1) {
+        shutdown(fd_, SHUT_RDWR);
+    }
+    if (reader_.joinable()) {
+        reader_.join();
+    }
+    if (fd_ != -1) {
+        close(fd_);
+    }
+}
+
+bool BackendConnection::ensureConnected() {
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        if (fd_ != -1 && !broken_) return true;
+    }
+
+    // Tear down the previous link; its reader has already failed everything it owned
+    if (fd_ != -1) {
+        shutdown(fd_, SHUT_RDWR);
+        if (reader_.joinable()) reader_.join();
+        close(fd_);
+        fd_ = -1;
+    }
+
+    int fd = connectTo(host_, port_);
+    if (fd < 0) return false;
+
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        broken_ = false;
+    }
+    fd_ = fd;
+    reader_ = std::thread(&BackendConnection::readLoop, this, fd);
+    return true;
+}
+
+void BackendConnection::submit(std::vector<BackendRequest>& batch) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+
+    auto fail = [&batch]() {
+        for (auto& req : batch) {
+            req.on_reply(Message::encode(req.cmd, req.key, "ERR backend unavailable"));
+        }
+    };
+
+    if (!ensureConnected()) {
+        fail();
+        return;
+    }
+
+    std::vector<uint8_t> buffer;
+    bool broken;
+    {
+        std::lock_guard<std::mutex> pending_lock(pending_mutex_);
+        broken = broken_;
+        if (!broken) {
+            for (auto& req : batch) {
+                buffer.insert(buffer.end(), req.frame.begin(), req.frame.end());
+                pending_.push_back(std::move(req));
+            }
+        }
+    }
+    if (broken) {
+        fail();
+        return;
+    }
+
+    if (!sendAll(fd_, buffer.data(), buffer.size())) {
+        // Wakes the reader, which fails everything still pending
+        shutdown(fd_, SHUT_RDWR);
+    }
+}
+
+// Replies are delivered outside pending_mutex_, since completing a client call does work
+void BackendConnection::readLoop(int fd) {
+    std::vector<uint8_t> frame;
+    while (readRawFrame(fd, frame)) {
+        std::function<void(std::vector<uint8_t>)> on_reply;
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex_);
+            if (pending_.empty()) break;  // Unsolicited reply: the stream is out of sync
+            on_reply = std::move(pending_.front().on_reply);
+            pending_.pop_front();
+        }
+        on_reply(std::move(frame));
+        frame = {};
+    }
+    failPending();
+}
+
+void BackendConnection::failPending() {
+    std::deque<BackendRequest> failed;
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        broken_ = true;
+        failed.swap(pending_);
+    }
+    for (auto& req : failed) {
+        req.on_reply(Message::encode(req.cmd, req.key, "ERR backend unavailable"));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Proxy
+// ---------------------------------------------------------------------------
+
+Proxy::Proxy(const std::vector<std::string>& backends, size_t conns_per_backend, size_t vnodes) : ring_(vnodes) {
+    for (const auto& addr : backends) {
+        auto colon = addr.rfind(':');
+        if (colon == std::string::npos) {
+            throw std::invalid_argument("Backend must be host:port, got " + addr);
+        }
+        if (by_addr_.count(addr)) continue;
+
+        auto backend = std::make_unique<Backend>();
+        backend->addr = addr;
+        for (size_t i = 0; i < conns_per_backend; ++i) {
+            backend->conns.push_back(
+                std::make_unique<BackendConnection>(addr.substr(0, colon), std::stoi(addr.substr(colon + 1))));
+        }
+        by_addr_[addr] = backend.get();
+        ring_.addNode(addr);
+        backends_.push_back(std::move(backend));
+    }
+    if (backends_.empty()) {
+        throw std::invalid_argument("Proxy needs at least one backend");
+    }
+}
+
+Proxy::Backend& Proxy::route(const std::string& key) {
+    return *by_addr_.at(ring_.locate(key));
+}
+
+// One slot per client frame; replies are assembled in request order
+struct Proxy::Slot {
+    Command cmd;
+    std::string key;
+    std::vector<std::vector<uint8_t>> parts;      // Backend replies, in dispatch order
+    std::vector<std::vector<size_t>> positions;  // MGET: original index of every key in each part
+    size_t num_keys = 0;
+    std::vector<uint8_t> local;  // Answered by the proxy itself
+};
+
+// The frames of one handle() call. Whoever delivers the last backend reply assembles
+// and sends the client's reply; dispatching holds one extra count until it is done.
+struct Proxy::Call {
+    std::vector<Slot> slots;
+    std::atomic<size_t> outstanding{1};
+    Reply reply;
+};
+
+void Proxy::handle(const std::vector<uint8_t>& data, size_t& consumed, Reply reply) {
+    auto call = std::make_shared<Call>();
+    call->reply = std::move(reply);
+    auto& slots = call->slots;
+    auto finish = [this, call]() {
+        if (--call->outstanding == 0) call->reply(assemble(*call));
+    };
+
+    // Each backend gets one connection and one write per call
+    std::unordered_map<Backend*, BackendConnection*> chosen;
+    std::unordered_map<BackendConnection*, std::vector<BackendRequest>> batches;
+
+    auto dispatch = [&](Backend& backend, size_t s, Command cmd, const std::string& key,
+                        std::vector<uint8_t> frame) {
+        auto& conn = chosen[&backend];
+        if (conn == nullptr) {
+            conn = backend.conns[backend.next++ % backend.conns.size()].get();
+        }
+        // slots no longer grows once the batches are submitted, so the part can be filled in place
+        size_t p = slots[s].parts.size();
+        slots[s].parts.emplace_back();
+        ++call->outstanding;
+        BackendRequest req{cmd, key, std::move(frame), [call, finish, s, p](std::vector<uint8_t> reply) {
+                               call->slots[s].parts[p] = std::move(reply);
+                               finish();
+                           }};
+        batches[conn].push_back(std::move(req));
+    };
+
+    size_t pos = 0;
+    while (data.size() - pos >= HEADER_SIZE) {
+        Header header = Message::decodeHeader(data.data() + pos);
+        if (header.magic != MAGIC) {
+            if (pos == 0) pos = 1;  // Resync like the server does
+            break;
+        }
+
+        size_t header_len = Message::headerSize(header);
+        size_t total_len = header_len + header.key_len + header.value_len;
+        if (data.size() - pos < total_len) break;
+
+        const uint8_t* body = data.data() + pos + header_len;
+        size_t s = slots.size();
+        Slot& slot = slots.emplace_back();
+        slot.cmd = static_cast<Command>(header.command);
+        slot.key.assign(reinterpret_cast<const char*>(body), header.key_len);
+        std::vector<uint8_t> frame(data.begin() + pos, data.begin() + pos + total_len);
+        pos += total_len;
+
+        // Backend replies are matched in order, so the proxy only speaks v1. It answers a
+        // negotiating PING with "unsupported", which keeps v2-capable clients on v1.
+        if (header.version >= VERSION_2) {
+            slot.local = Message::encodeV2(slot.cmd, slot.key, "ERR protocol v2 not supported by proxy",
+                                           Message::decodeExt(data.data() + pos - total_len).request_id);
+            continue;
+        }
+
+        switch (slot.cmd) {
+            case Command::SET:
+            case Command::GET:
+            case Command::DEL:
+            case Command::INCR:
+            case Command::DECR:
+            case Command::APPEND:
+            case Command::GETS:
+            case Command::CAS:
+                dispatch(route(slot.key), s, slot.cmd, slot.key, std::move(frame));
+                break;
+            case Command::MGET: {
+                std::string packed(reinterpret_cast<const char*>(body + header.key_len), header.value_len);
+                std::vector<std::string> keys;
+                if (!MultiKey::unpackKeys(packed, keys)) {
+                    slot.local = Message::encode(slot.cmd, slot.key, "ERR malformed MGET");
+                    break;
+                }
+                slot.num_keys = keys.size();
+
+                // Split the keys into one sub-request per backend
+                std::unordered_map<Backend*, std::pair<std::vector<std::string>, std::vector<size_t>>> groups;
+                for (size_t i = 0; i < keys.size(); ++i) {
+                    auto& group = groups[&route(keys[i])];
+                    group.first.push_back(std::move(keys[i]));
+                    group.second.push_back(i);
+                }
+                for (auto& [backend, group] : groups) {
+                    dispatch(*backend, s, slot.cmd, slot.key,
+                             Message::encode(Command::MGET, "", MultiKey::packKeys(group.first)));
+                    slot.positions.push_back(std::move(group.second));
+                }
+                break;
+            }
+            case Command::STATS:
+                for (auto& backend : backends_) {
+                    dispatch(*backend, s, slot.cmd, slot.key, frame);
+                }
+                break;
+            default:
+                slot.local = Message::encode(slot.cmd, slot.key, "ERR unsupported command");
+                break;
+        }
+    }
+    consumed = pos;
+    if (consumed == 0) return;  // No reply is expected
+
+    for (auto& [conn, batch] : batches) {
+        conn->submit(batch);
+    }
+    finish();
+}
+
+std::vector<uint8_t> Proxy::assemble(Call& call) const {
+    std::vector<uint8_t> response;
+    for (auto& slot : call.slots) {
+        std::vector<uint8_t> reply;
+        if (!slot.local.empty()) {
+            reply = std::move(slot.local);
+        } else if (slot.cmd == Command::MGET) {
+            // A backend that is down or failed fails the whole MGET; its keys are not misses
+            std::vector<std::optional<std::string>> values(slot.num_keys);
+            std::string error;
+            for (size_t p = 0; p < slot.parts.size() && error.empty(); ++p) {
+                std::string value = replyValue(slot.parts[p]);
+                std::vector<std::optional<std::string>> part;
+                if (value.rfind("ERR", 0) == 0) {
+                    error = value;  // Packed values start with a 0/1 flag, never with "ERR"
+                } else if (!MultiKey::unpackValues(value, part) || part.size() != slot.positions[p].size()) {
+                    error = "ERR malformed MGET reply from backend";
+                } else {
+                    for (size_t i = 0; i < part.size(); ++i) {
+                        values[slot.positions[p][i]] = std::move(part[i]);
+                    }
+                }
+            }
+            reply = Message::encode(slot.cmd, slot.key, error.empty() ? MultiKey::packValues(values) : error);
+        } else if (slot.cmd == Command::STATS) {
+            std::string combined = "Backends: " + std::to_string(backends_.size());
+            for (size_t p = 0; p < slot.parts.size(); ++p) {
+                combined += "; [" + backends_[p]->addr + "] " + replyValue(slot.parts[p]);
+            }
+            reply = Message::encode(slot.cmd, slot.key, combined);
+        } else {
+            reply = std::move(slot.parts[0]);
+        }
+        response.insert(response.end(), reply.begin(), reply.end());
+    }
+    return response;
+}
+
+}  // namespace kvcache
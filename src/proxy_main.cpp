@@ -0,0 +1,62 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "proxy.h"
+#include "tcp_server.h"
+
+using namespace kvcache;
+
+void usage(const char* prog) {
+    std::cerr << "Usage: " << prog
+              << " <port> <host:port> [host:port ...] [--conns-per-backend <n>] [--vnodes <n>] [--threads <n>]"
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int port = -1;
+    size_t conns_per_backend = 2;
+    size_t vnodes = 160;
+    int threads = 4;
+    std::vector<std::string> backends;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--conns-per-backend" && i + 1 < argc) {
+            conns_per_backend = std::stoul(argv[++i]);
+        } else if (arg == "--vnodes" && i + 1 < argc) {
+            vnodes = std::stoul(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::stoi(argv[++i]);
+        } else if (!arg.empty() && arg[0] != '-' && port < 0) {
+            port = std::stoi(arg);
+        } else if (!arg.empty() && arg[0] != '-') {
+            backends.push_back(arg);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (port < 0 || backends.empty() || conns_per_backend == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        Proxy proxy(backends, conns_per_backend, vnodes);
+
+        std::cout << "Proxying to " << backends.size() << " backends (" << vnodes << " virtual nodes each)"
+                  << std::endl;
+        TcpServer server(port, threads);
+        server.setAsyncHandler([&proxy](const std::vector<uint8_t>& data, size_t& consumed, TcpServer::Reply reply) {
+            proxy.handle(data, consumed, std::move(reply));
+        });
+        server.start();
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,375 @@
+#include "replication.h"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "socket_io.h"
+
+namespace kvcache {
+
+namespace {
+
+constexpr size_t SNAPSHOT_CHUNK_BYTES = 1 << 20;  // Send granularity once the shard locks are released
+
+int64_t nowMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+// ---------------------------------------------------------------------------
+// ReplicationPrimary
+// ---------------------------------------------------------------------------
+
+ReplicationPrimary::ReplicationPrimary(int port, SnapshotFn snapshot, int heartbeat_ms, size_t max_backlog)
+    : port_(port)
+    , server_fd_(-1)
+    , heartbeat_ms_(heartbeat_ms)
+    , max_backlog_(max_backlog)
+    , snapshot_(std::move(snapshot))
+    , running_(false)
+    , offset_(0) {
+}
+
+ReplicationPrimary::~ReplicationPrimary() {
+    stop();
+}
+
+void ReplicationPrimary::start() {
+    server_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd_ < 0) {
+        throw std::runtime_error("Failed to create replication socket");
+    }
+
+    int opt = 1;
+    setsockopt(server_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port_);
+
+    if (bind(server_fd_, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        throw std::runtime_error("Failed to bind replication socket");
+    }
+
+    if (listen(server_fd_, SOMAXCONN) < 0) {
+        throw std::runtime_error("Failed to listen on replication socket");
+    }
+
+    running_ = true;
+    accept_thread_ = std::thread(&ReplicationPrimary::acceptLoop, this);
+    std::cout << "Replication listening on port " << port_ << std::endl;
+}
+
+void ReplicationPrimary::stop() {
+    if (!running_.exchange(false)) return;
+
+    // Unblocks accept()
+    shutdown(server_fd_, SHUT_RDWR);
+    if (accept_thread_.joinable()) {
+        accept_thread_.join();
+    }
+    close(server_fd_);
+    server_fd_ = -1;
+
+    std::vector<std::shared_ptr<Replica>> replicas;
+    {
+        std::lock_guard<std::mutex> lock(replicas_mutex_);
+        replicas.swap(replicas_);
+    }
+    for (auto& replica : replicas) {
+        {
+            std::lock_guard<std::mutex> lock(replica->mutex);
+            replica->closed = true;
+        }
+        replica->cv.notify_all();
+        shutdown(replica->fd, SHUT_RDWR);
+        if (replica->sender.joinable()) {
+            replica->sender.join();
+        }
+        close(replica->fd);
+    }
+}
+
+void ReplicationPrimary::feed(const std::vector<uint8_t>& frame) {
+    std::lock_guard<std::mutex> lock(replicas_mutex_);
+    offset_++;
+    for (auto& replica : replicas_) {
+        bool notify = false;
+        {
+            std::lock_guard<std::mutex> replica_lock(replica->mutex);
+            if (!replica->live || replica->closed) continue;
+            if (replica->queue.size() >= max_backlog_) {
+                // Too far behind: cut it off, the replica reconnects and does a full sync
+                replica->closed = true;
+            } else {
+                replica->queue.push(frame);
+            }
+            notify = true;
+        }
+        if (notify) replica->cv.notify_one();
+    }
+}
+
+size_t ReplicationPrimary::replicaCount() {
+    std::lock_guard<std::mutex> lock(replicas_mutex_);
+    size_t count = 0;
+    for (auto& replica : replicas_) {
+        std::lock_guard<std::mutex> replica_lock(replica->mutex);
+        if (replica->live && !replica->closed) count++;
+    }
+    return count;
+}
+
+void ReplicationPrimary::acceptLoop() {
+    while (running_) {
+        int fd = accept(server_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        // Don't let a silent peer stall the accept loop during the handshake
+        timeval timeout{5, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        Command cmd;
+        std::string key, value;
+        if (!readFrame(fd, cmd, key, value) || cmd != Command::SYNC) {
+            close(fd);
+            continue;
+        }
+
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        auto replica = std::make_shared<Replica>();
+        replica->fd = fd;
+
+        // Reap replicas whose link has gone away. Their threads are joined outside the
+        // lock since a syncing sender takes replicas_mutex_ from inside the snapshot.
+        std::vector<std::shared_ptr<Replica>> dead;
+        {
+            std::lock_guard<std::mutex> lock(replicas_mutex_);
+            for (auto it = replicas_.begin(); it != replicas_.end();) {
+                bool closed;
+                {
+                    std::lock_guard<std::mutex> replica_lock((*it)->mutex);
+                    closed = (*it)->closed;
+                }
+                if (closed) {
+                    dead.push_back(*it);
+                    it = replicas_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            replicas_.push_back(replica);
+            replica->sender = std::thread(&ReplicationPrimary::serveReplica, this, replica);
+        }
+        for (auto& r : dead) {
+            shutdown(r->fd, SHUT_RDWR);
+            r->sender.join();
+            close(r->fd);
+        }
+    }
+}
+
+void ReplicationPrimary::serveReplica(std::shared_ptr<Replica> replica) {
+    // Shutting the socket down tells the replica to reconnect and resync
+    auto disconnect = [&replica]() {
+        {
+            std::lock_guard<std::mutex> lock(replica->mutex);
+            replica->closed = true;
+        }
+        shutdown(replica->fd, SHUT_RDWR);
+    };
+
+    // Full sync. Frames visited under the shard locks are buffered so no socket I/O happens
+    // while writes wait; once the locks are released the rest goes out in chunks.
+    std::vector<uint8_t> snapshot;
+    bool unlocked = false;
+    bool failed = false;
+    auto flush = [&replica, &snapshot, &failed]() {
+        if (!failed && !sendAll(replica->fd, snapshot.data(), snapshot.size())) failed = true;
+        snapshot.clear();
+    };
+    auto go_live = [this, &replica]() {
+        // Every shard is locked: no write can land between the snapshot and the stream
+        std::lock_guard<std::mutex> lock(replicas_mutex_);
+        std::lock_guard<std::mutex> replica_lock(replica->mutex);
+        replica->start_offset = offset_;
+        replica->live = true;
+    };
+    snapshot_(
+        go_live,
+        [&snapshot, &unlocked, &flush](const std::string& key, const std::string& value) {
+            auto frame = Message::encode(Command::SET, key, value);
+            snapshot.insert(snapshot.end(), frame.begin(), frame.end());
+            if (unlocked && snapshot.size() >= SNAPSHOT_CHUNK_BYTES) flush();
+        },
+        [&snapshot, &unlocked, &flush]() {
+            unlocked = true;
+            flush();
+            snapshot.shrink_to_fit();
+        });
+    auto marker = Message::encode(Command::SYNC, "", std::to_string(replica->start_offset));
+    snapshot.insert(snapshot.end(), marker.begin(), marker.end());
+    flush();
+    if (failed) {
+        disconnect();
+        return;
+    }
+    snapshot.shrink_to_fit();
+
+    // Stream. The PING carries the primary's offset and clock, so it also goes out
+    // every heartbeat while writes keep the link busy, or the replica's lag would go stale.
+    std::queue<std::vector<uint8_t>> pending;
+    int64_t last_ping = nowMs();
+    while (running_) {
+        bool idle;
+        {
+            std::unique_lock<std::mutex> lock(replica->mutex);
+            idle = !replica->cv.wait_for(lock, std::chrono::milliseconds(heartbeat_ms_),
+                                         [&replica] { return !replica->queue.empty() || replica->closed; });
+            if (replica->closed) break;
+            pending.swap(replica->queue);
+        }
+
+        std::vector<uint8_t> batch;
+        while (!pending.empty()) {
+            auto& frame = pending.front();
+            batch.insert(batch.end(), frame.begin(), frame.end());
+            pending.pop();
+        }
+        int64_t now = nowMs();
+        if (idle || now - last_ping >= heartbeat_ms_) {
+            auto ping = Message::encode(Command::PING, std::to_string(now), std::to_string(offset_.load()));
+            batch.insert(batch.end(), ping.begin(), ping.end());
+            last_ping = now;
+        }
+
+        if (!sendAll(replica->fd, batch.data(), batch.size())) {
+            break;
+        }
+    }
+    disconnect();
+}
+
+// ---------------------------------------------------------------------------
+// ReplicaClient
+// ---------------------------------------------------------------------------
+
+ReplicaClient::ReplicaClient(const std::string& host, int port, ApplyFn apply, ResetFn reset)
+    : host_(host)
+    , port_(port)
+    , apply_(std::move(apply))
+    , reset_(std::move(reset))
+    , running_(false)
+    , fd_(-1)
+    , connected_(false)
+    , synced_(false)
+    , offset_(0)
+    , primary_offset_(0)
+    , lag_ms_(0)
+    , last_io_(0) {
+}
+
+ReplicaClient::~ReplicaClient() {
+    stop();
+}
+
+void ReplicaClient::start() {
+    running_ = true;
+    thread_ = std::thread(&ReplicaClient::syncLoop, this);
+}
+
+void ReplicaClient::stop() {
+    if (!running_.exchange(false)) return;
+    int fd = fd_.load();
+    if (fd != -1) {
+        shutdown(fd, SHUT_RDWR);
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+ReplicaClient::Status ReplicaClient::status() const {
+    Status s;
+    s.connected = connected_;
+    s.synced = synced_;
+    s.offset = offset_;
+    s.primary_offset = primary_offset_;
+    s.lag_ms = lag_ms_;
+    s.last_io_ms = last_io_ > 0 ? nowMs() - last_io_ : 0;
+    return s;
+}
+
+void ReplicaClient::syncLoop() {
+    while (running_) {
+        int fd = connectTo(host_, port_);
+        if (fd < 0) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            continue;
+        }
+
+        fd_ = fd;
+        connected_ = true;
+        std::cout << "Connected to primary " << host_ << ":" << port_ << ", starting full sync" << std::endl;
+
+        runSession(fd);
+
+        connected_ = false;
+        synced_ = false;
+        fd_ = -1;
+        close(fd);
+        if (running_) {
+            std::cerr << "Lost connection to primary, reconnecting..." << std::endl;
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+    }
+}
+
+void ReplicaClient::runSession(int fd) {
+    auto request = Message::encode(Command::SYNC, "");
+    if (!sendAll(fd, request.data(), request.size())) return;
+
+    // A full sync replaces whatever an earlier session left behind
+    reset_();
+
+    Command cmd;
+    std::string key, value;
+    while (running_ && readFrame(fd, cmd, key, value)) {
+        last_io_ = nowMs();
+        switch (cmd) {
+            case Command::SYNC:
+                offset_ = std::stoull(value);
+                primary_offset_ = offset_.load();
+                synced_ = true;
+                std::cout << "Full sync complete at offset " << offset_ << std::endl;
+                break;
+            case Command::PING:
+                primary_offset_ = std::stoull(value);
+                lag_ms_ = last_io_ - std::stoll(key);
+                break;
+            default:
+                // Snapshot SETs before the marker, logged write commands after it
+                apply_(cmd, key, value);
+                if (synced_ && ++offset_ > primary_offset_) {
+                    primary_offset_ = offset_.load();
+                }
+                break;
+        }
+    }
+}
+
+}  // namespace kvcache
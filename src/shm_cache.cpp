@@ -0,0 +1,406 @@
+#include "shm_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+
+#include "numa.h"
+
+namespace kvcache {
+
+namespace {
+
+constexpr uint64_t kRegionMagic = 0x4b56534853484d31ULL;  // "KVSHSHM1"
+
+constexpr size_t align(size_t n, size_t to) {
+    return (n + to - 1) / to * to;
+}
+
+struct RegionHeader {
+    uint64_t magic;
+    uint32_t layout_version;
+    std::atomic<uint32_t> ready;  // Set last, once every shard is initialized
+    ShmRegion::Geometry geometry;
+    uint64_t shard_stride;
+};
+
+bool sameGeometry(const ShmRegion::Geometry& a, const ShmRegion::Geometry& b) {
+    return a.num_shards == b.num_shards && a.capacity_per_shard == b.capacity_per_shard &&
+           a.slot_bytes == b.slot_bytes && a.route_fingerprint == b.route_fingerprint;
+}
+
+}  // namespace
+
+struct ShmShard::Header {
+    pthread_mutex_t mutex;
+    uint32_t head;  // LRU list, most recent first
+    uint32_t tail;
+    uint32_t free_head;
+    uint32_t count;
+    uint32_t num_buckets;
+    uint64_t next_version;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+// Key bytes then value bytes follow the fixed part
+struct ShmShard::Slot {
+    uint32_t prev;
+    uint32_t next;   // LRU successor, or free-list link
+    uint32_t chain;  // Next slot in the same bucket
+    uint32_t key_len;
+    uint32_t value_len;
+    uint64_t hash;
+    uint64_t version;
+};
+
+// ---------------------------------------------------------------------------
+// ShmRegion
+// ---------------------------------------------------------------------------
+
+ShmRegion::ShmRegion(const std::string& name, const Geometry& geometry)
+    : name_(name), geometry_(geometry), base_(nullptr), size_(0), shard_offset_(0), shard_stride_(0),
+      attached_(false) {
+    // Shards start on page boundaries, so bindShard can move every page of a shard,
+    // its header with the mutex and LRU ends included
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    shard_offset_ = align(sizeof(RegionHeader), page);
+    shard_stride_ = align(ShmShard::bytesFor(geometry), page);
+    size_ = shard_offset_ + shard_stride_ * geometry.num_shards;
+
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        throw std::runtime_error("shm_open failed for " + name + ": " + std::strerror(errno));
+    }
+
+    struct stat st{};
+    fstat(fd, &st);
+    bool reuse = static_cast<size_t>(st.st_size) == size_;
+    if (!reuse) {
+        // Truncating to zero first guarantees a zero-filled segment
+        if (ftruncate(fd, 0) < 0 || ftruncate(fd, size_) < 0) {
+            close(fd);
+            throw std::runtime_error("ftruncate failed for " + name + ": " + std::strerror(errno));
+        }
+    }
+
+    base_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base_ == MAP_FAILED) {
+        base_ = nullptr;
+        throw std::runtime_error("mmap failed for " + name + ": " + std::strerror(errno));
+    }
+
+    auto* header = static_cast<RegionHeader*>(base_);
+    if (reuse && header->magic == kRegionMagic && header->layout_version == kLayoutVersion &&
+        header->ready.load(std::memory_order_acquire) == 1 && sameGeometry(header->geometry, geometry) &&
+        header->shard_stride == shard_stride_) {
+        attached_ = true;
+        return;
+    }
+
+    // Cold start: lay out every shard from scratch
+    header->ready.store(0, std::memory_order_relaxed);
+    header->magic = kRegionMagic;
+    header->layout_version = kLayoutVersion;
+    header->geometry = geometry;
+    header->shard_stride = shard_stride_;
+
+    for (size_t i = 0; i < geometry.num_shards; ++i) {
+        ShmShard::format(*this, i);
+    }
+
+    header->ready.store(1, std::memory_order_release);
+}
+
+ShmRegion::~ShmRegion() {
+    if (base_) {
+        munmap(base_, size_);
+    }
+}
+
+void* ShmRegion::shard(size_t index) const {
+    return static_cast<char*>(base_) + shard_offset_ + index * shard_stride_;
+}
+
+bool ShmRegion::bindShard(size_t index, int node) {
+    return bindMemory(shard(index), shard_stride_, node);
+}
+
+void ShmRegion::unlink(const std::string& name) {
+    shm_unlink(name.c_str());
+}
+
+// ---------------------------------------------------------------------------
+// ShmShard
+// ---------------------------------------------------------------------------
+
+void ShmShard::Mutex::lock() {
+    int rc = pthread_mutex_lock(&shard_->header_->mutex);
+    if (rc == EOWNERDEAD) {
+        // A previous process died inside the critical section; the lists may be torn
+        std::cerr << "Shared-memory shard owner died mid-update, clearing shard" << std::endl;
+        shard_->resetLocked();
+        shard_->recovered_ = true;
+        pthread_mutex_consistent(&shard_->header_->mutex);
+    } else if (rc != 0) {
+        throw std::system_error(rc, std::generic_category(), "pthread_mutex_lock");
+    }
+}
+
+void ShmShard::Mutex::unlock() {
+    pthread_mutex_unlock(&shard_->header_->mutex);
+}
+
+size_t ShmShard::bytesFor(const ShmRegion::Geometry& geometry) {
+    size_t buckets = std::bit_ceil(std::max<uint32_t>(geometry.capacity_per_shard, 1)) * 2;
+    return align(sizeof(Header), 64) + align(buckets * sizeof(uint32_t), 64) +
+           static_cast<size_t>(geometry.capacity_per_shard) * align(sizeof(Slot) + geometry.slot_bytes, 8);
+}
+
+void ShmShard::format(ShmRegion& region, size_t index) {
+    auto* header = static_cast<Header*>(region.shard(index));
+    std::memset(static_cast<void*>(header), 0, sizeof(Header));
+    header->num_buckets = std::bit_ceil(std::max<uint32_t>(region.geometry().capacity_per_shard, 1)) * 2;
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&header->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    ShmShard shard(region, index);
+    shard.clear();
+}
+
+ShmShard::ShmShard(ShmRegion& region, size_t index)
+    : header_(static_cast<Header*>(region.shard(index)))
+    , slots_(nullptr)
+    , buckets_(nullptr)
+    , slot_stride_(align(sizeof(Slot) + region.geometry().slot_bytes, 8))
+    , capacity_(region.geometry().capacity_per_shard)
+    , slot_bytes_(region.geometry().slot_bytes)
+    , mutex_(this) {
+    auto* base = reinterpret_cast<char*>(header_);
+    buckets_ = reinterpret_cast<uint32_t*>(base + align(sizeof(Header), 64));
+    slots_ = reinterpret_cast<char*>(buckets_) + align(header_->num_buckets * sizeof(uint32_t), 64);
+
+    // Take the lock once now, so a shard left locked by a dead process is wiped (and
+    // reported by recovered()) before the caller decides how to warm up
+    std::lock_guard<Mutex> lock(mutex_);
+}
+
+uint64_t ShmShard::hashKey(std::string_view key) {
+    // FNV-1a: stable across builds, unlike std::hash
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+ShmShard::Slot* ShmShard::slotAt(uint32_t index) const {
+    return reinterpret_cast<Slot*>(slots_ + static_cast<size_t>(index) * slot_stride_);
+}
+
+std::string_view ShmShard::keyLocked(uint32_t slot) const {
+    Slot* s = slotAt(slot);
+    return {reinterpret_cast<const char*>(s + 1), s->key_len};
+}
+
+std::string_view ShmShard::valueLocked(uint32_t slot) const {
+    Slot* s = slotAt(slot);
+    return {reinterpret_cast<const char*>(s + 1) + s->key_len, s->value_len};
+}
+
+uint64_t ShmShard::versionLocked(uint32_t slot) const {
+    return slotAt(slot)->version;
+}
+
+uint32_t ShmShard::headLocked() const {
+    return header_->head;
+}
+
+uint32_t ShmShard::nextLocked(uint32_t slot) const {
+    return slotAt(slot)->next;
+}
+
+uint32_t ShmShard::findLocked(const std::string& key, uint64_t hash) const {
+    for (uint32_t i = buckets_[hash & (header_->num_buckets - 1)]; i != kNil; i = slotAt(i)->chain) {
+        Slot* s = slotAt(i);
+        if (s->hash == hash && s->key_len == key.size() && std::memcmp(s + 1, key.data(), key.size()) == 0) {
+            return i;
+        }
+    }
+    return kNil;
+}
+
+void ShmShard::touchLocked(uint32_t slot) {
+    if (header_->head == slot) return;
+    Slot* s = slotAt(slot);
+
+    // Unlink
+    slotAt(s->prev)->next = s->next;
+    if (s->next != kNil) {
+        slotAt(s->next)->prev = s->prev;
+    } else {
+        header_->tail = s->prev;
+    }
+
+    // Push front
+    s->prev = kNil;
+    s->next = header_->head;
+    slotAt(header_->head)->prev = slot;
+    header_->head = slot;
+}
+
+void ShmShard::eraseLocked(uint32_t slot) {
+    Slot* s = slotAt(slot);
+
+    uint32_t* link = &buckets_[s->hash & (header_->num_buckets - 1)];
+    while (*link != slot) {
+        link = &slotAt(*link)->chain;
+    }
+    *link = s->chain;
+
+    if (s->prev != kNil) {
+        slotAt(s->prev)->next = s->next;
+    } else {
+        header_->head = s->next;
+    }
+    if (s->next != kNil) {
+        slotAt(s->next)->prev = s->prev;
+    } else {
+        header_->tail = s->prev;
+    }
+
+    s->next = header_->free_head;
+    header_->free_head = slot;
+    header_->count--;
+}
+
+uint64_t ShmShard::writeLocked(const std::string& key, const std::string& value, uint64_t hash, uint32_t slot) {
+    if (key.size() + value.size() > slot_bytes_ || capacity_ == 0) {
+        // Not cacheable here; drop any older value so readers don't see it
+        if (slot != kNil) eraseLocked(slot);
+        return 0;
+    }
+
+    if (slot == kNil) {
+        if (header_->free_head == kNil) {
+            eraseLocked(header_->tail);  // Evict least recently used
+        }
+        slot = header_->free_head;
+        Slot* s = slotAt(slot);
+        header_->free_head = s->next;
+
+        s->hash = hash;
+        s->key_len = key.size();
+        std::memcpy(s + 1, key.data(), key.size());
+
+        uint32_t& bucket = buckets_[hash & (header_->num_buckets - 1)];
+        s->chain = bucket;
+        bucket = slot;
+
+        s->prev = kNil;
+        s->next = header_->head;
+        if (header_->head != kNil) {
+            slotAt(header_->head)->prev = slot;
+        } else {
+            header_->tail = slot;
+        }
+        header_->head = slot;
+        header_->count++;
+    } else {
+        touchLocked(slot);
+    }
+
+    Slot* s = slotAt(slot);
+    s->value_len = value.size();
+    std::memcpy(reinterpret_cast<char*>(s + 1) + s->key_len, value.data(), value.size());
+    s->version = ++header_->next_version;
+    return s->version;
+}
+
+void ShmShard::resetLocked() {
+    header_->head = kNil;
+    header_->tail = kNil;
+    header_->count = 0;
+    std::memset(buckets_, 0xff, header_->num_buckets * sizeof(uint32_t));
+
+    header_->free_head = capacity_ > 0 ? 0 : kNil;
+    for (uint32_t i = 0; i < capacity_; ++i) {
+        slotAt(i)->next = i + 1 < capacity_ ? i + 1 : kNil;
+    }
+}
+
+void ShmShard::put(const std::string& key, const std::string& value) {
+    std::lock_guard<Mutex> lock(mutex_);
+    uint64_t hash = hashKey(key);
+    writeLocked(key, value, hash, findLocked(key, hash));
+}
+
+std::optional<std::string> ShmShard::get(const std::string& key) {
+    std::lock_guard<Mutex> lock(mutex_);
+    uint32_t slot = findLocked(key, hashKey(key));
+    if (slot == kNil) {
+        header_->misses++;
+        return std::nullopt;
+    }
+    header_->hits++;
+    touchLocked(slot);
+    return std::string(valueLocked(slot));
+}
+
+std::optional<std::pair<std::string, uint64_t>> ShmShard::getVersioned(const std::string& key) {
+    std::lock_guard<Mutex> lock(mutex_);
+    uint32_t slot = findLocked(key, hashKey(key));
+    if (slot == kNil) {
+        header_->misses++;
+        return std::nullopt;
+    }
+    header_->hits++;
+    touchLocked(slot);
+    return std::make_pair(std::string(valueLocked(slot)), versionLocked(slot));
+}
+
+bool ShmShard::exists(const std::string& key) {
+    std::lock_guard<Mutex> lock(mutex_);
+    return findLocked(key, hashKey(key)) != kNil;
+}
+
+bool ShmShard::remove(const std::string& key) {
+    return remove(key, [] {});
+}
+
+void ShmShard::clear() {
+    std::lock_guard<Mutex> lock(mutex_);
+    resetLocked();
+}
+
+size_t ShmShard::size() const {
+    std::lock_guard<Mutex> lock(mutex_);
+    return header_->count;
+}
+
+ShmShard::Stats ShmShard::getStats() const {
+    std::lock_guard<Mutex> lock(mutex_);
+    Stats stats;
+    stats.hits = header_->hits;
+    stats.misses = header_->misses;
+    return stats;
+}
+
+}  // namespace kvcache
@@ -0,0 +1,86 @@
+#include "socket_io.h"
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+namespace kvcache {
+
+bool sendAll(int fd, const uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool readExact(int fd, void* out, size_t len) {
+    auto* p = static_cast<uint8_t*>(out);
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool readRawFrame(int fd, std::vector<uint8_t>& frame) {
+    frame.resize(HEADER_SIZE);
+    if (!readExact(fd, frame.data(), HEADER_SIZE)) return false;
+
+    Header header = Message::decodeHeader(frame.data());
+    if (header.magic != MAGIC) return false;
+
+    size_t body_len = static_cast<size_t>(header.key_len) + header.value_len;
+    frame.resize(HEADER_SIZE + body_len);
+    return body_len == 0 || readExact(fd, frame.data() + HEADER_SIZE, body_len);
+}
+
+bool readFrame(int fd, Command& cmd, std::string& key, std::string& value) {
+    uint8_t raw[HEADER_SIZE];
+    if (!readExact(fd, raw, HEADER_SIZE)) return false;
+
+    Header header = Message::decodeHeader(raw);
+    if (header.magic != MAGIC) return false;
+
+    key.assign(header.key_len, '\0');
+    value.assign(header.value_len, '\0');
+    if (header.key_len > 0 && !readExact(fd, &key[0], header.key_len)) return false;
+    if (header.value_len > 0 && !readExact(fd, &value[0], header.value_len)) return false;
+
+    cmd = static_cast<Command>(header.command);
+    return true;
+}
+
+int connectTo(const std::string& host, int port) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+        return -1;
+    }
+
+    int fd = -1;
+    for (addrinfo* ai = result; ai != nullptr; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    return fd;
+}
+
+}  // namespace kvcache
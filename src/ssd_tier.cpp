@@ -0,0 +1,425 @@
+#include "ssd_tier.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+namespace kvcache {
+
+namespace {
+
+// On-disk record: header, key bytes, value bytes
+struct RecordHeader {
+    uint32_t key_len;
+    uint32_t value_len;
+};
+
+bool parseRecord(const char* data, size_t size, std::string_view& key, std::string_view& value) {
+    RecordHeader header;
+    if (size < sizeof(header)) return false;
+    std::memcpy(&header, data, sizeof(header));
+    if (size - sizeof(header) < static_cast<uint64_t>(header.key_len) + header.value_len) return false;
+    key = std::string_view(data + sizeof(header), header.key_len);
+    value = std::string_view(data + sizeof(header) + header.key_len, header.value_len);
+    return true;
+}
+
+bool sameLocation(const TierLog::Location& a, const TierLog::Location& b) {
+    return a.segment == b.segment && a.offset == b.offset;
+}
+
+}  // namespace
+
+// ---------------------------------------------------------------------------
+// TierLog
+// ---------------------------------------------------------------------------
+
+TierLog::Segment::~Segment() {
+    if (fd != -1) close(fd);
+}
+
+TierLog::TierLog(const std::string& path_prefix, size_t segment_bytes)
+    : path_prefix_(path_prefix), segment_bytes_(segment_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!openSegmentLocked()) {
+        throw std::runtime_error("Failed to create tier segment " + path_prefix_ + ": " + std::strerror(errno));
+    }
+}
+
+TierLog::~TierLog() {
+    for (auto& [id, segment] : segments_) {
+        unlink(segment->path.c_str());
+    }
+}
+
+uint64_t TierLog::hashKey(const std::string& key) {
+    return std::hash<std::string>()(key);
+}
+
+std::shared_ptr<TierLog::Segment> TierLog::openSegmentLocked() {
+    auto segment = std::make_shared<Segment>();
+    segment->id = next_segment_++;
+    segment->path = path_prefix_ + "-" + std::to_string(segment->id) + ".tier";
+    segment->fd = open(segment->path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (segment->fd < 0) return nullptr;
+    segments_[segment->id] = segment;
+    return segment;
+}
+
+std::shared_ptr<TierLog::Segment> TierLog::segmentFor(const Location& loc) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = segments_.find(loc.segment);
+    return it == segments_.end() ? nullptr : it->second;
+}
+
+void TierLog::unindexLocked(const Location& loc) {
+    auto it = segments_.find(loc.segment);
+    if (it != segments_.end()) {
+        it->second->live -= loc.size;
+    }
+}
+
+void TierLog::put(const std::string& key, const std::string& value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    appendLocked(key, value);
+}
+
+void TierLog::appendLocked(const std::string& key, const std::string& value) {
+    uint64_t hash = hashKey(key);
+    auto old = index_.find(hash);
+    if (old != index_.end()) {
+        unindexLocked(old->second);
+        index_.erase(old);
+    }
+
+    size_t record_size = sizeof(RecordHeader) + key.size() + value.size();
+    auto active = segments_.rbegin()->second;
+    if (active->size > 0 && active->size + record_size > segment_bytes_) {
+        // Seal the active segment; on failure keep appending to it
+        if (auto next = openSegmentLocked()) active = next;
+    }
+    if (active->size + record_size > UINT32_MAX) return;  // Offsets are 32-bit
+
+    std::string record(record_size, '\0');
+    RecordHeader header{static_cast<uint32_t>(key.size()), static_cast<uint32_t>(value.size())};
+    std::memcpy(record.data(), &header, sizeof(header));
+    std::memcpy(record.data() + sizeof(header), key.data(), key.size());
+    std::memcpy(record.data() + sizeof(header) + key.size(), value.data(), value.size());
+
+    // Lands in the page cache; the tier is scratch space, so there is no fsync
+    if (pwrite(active->fd, record.data(), record.size(), active->size) != static_cast<ssize_t>(record.size())) {
+        return;  // The entry is dropped, like a plain eviction
+    }
+
+    index_[hash] = Location{active->id, static_cast<uint32_t>(active->size), static_cast<uint32_t>(record_size)};
+    active->size += record_size;
+    active->live += record_size;
+    bytes_ += record_size;
+}
+
+std::optional<TierLog::Location> TierLog::find(const std::string& key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(hashKey(key));
+    if (it == index_.end()) return std::nullopt;
+    return it->second;
+}
+
+std::optional<TierLog::Location> TierLog::lookup(const std::string& key) {
+    auto loc = find(key);
+    if (!loc) stats_.misses++;
+    return loc;
+}
+
+std::optional<std::string> TierLog::read(const std::string& key, const Location& loc) {
+    auto segment = segmentFor(loc);
+    if (!segment) return std::nullopt;
+
+    auto start = std::chrono::steady_clock::now();
+    std::string record(loc.size, '\0');
+    if (pread(segment->fd, record.data(), loc.size, loc.offset) != static_cast<ssize_t>(loc.size)) {
+        return std::nullopt;
+    }
+
+    std::string_view record_key, value;
+    if (!parseRecord(record.data(), record.size(), record_key, value)) return std::nullopt;
+    if (record_key != key) {
+        stats_.misses++;  // Hash collision: the tier holds another key
+        return std::nullopt;
+    }
+
+    stats_.hits++;
+    stats_.read_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start)
+                          .count();
+    return std::string(value);
+}
+
+bool TierLog::erase(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(hashKey(key));
+    if (it == index_.end()) return false;
+    unindexLocked(it->second);
+    index_.erase(it);
+    return true;
+}
+
+bool TierLog::eraseAt(const std::string& key, const Location& loc) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(hashKey(key));
+    if (it == index_.end() || !sameLocation(it->second, loc)) return false;
+    unindexLocked(it->second);
+    index_.erase(it);
+    return true;
+}
+
+void TierLog::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    index_.clear();
+    for (auto& [id, segment] : segments_) {
+        unlink(segment->path.c_str());
+    }
+    segments_.clear();
+    bytes_ = 0;
+    if (!openSegmentLocked()) {
+        throw std::runtime_error("Failed to create tier segment " + path_prefix_ + ": " + std::strerror(errno));
+    }
+}
+
+void TierLog::forEach(const std::function<void(const std::string&, const std::string&)>& fn) const {
+    forEach(records(), fn);
+}
+
+TierLog::Records TierLog::records() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Records records;
+    records.reserve(index_.size());
+    for (const auto& [hash, loc] : index_) {
+        records.emplace_back(loc, segments_.at(loc.segment));
+    }
+    return records;
+}
+
+void TierLog::forEach(const Records& records, const std::function<void(const std::string&, const std::string&)>& fn) {
+    std::string record;
+    for (const auto& [loc, segment] : records) {
+        record.resize(loc.size);
+        if (pread(segment->fd, record.data(), loc.size, loc.offset) != static_cast<ssize_t>(loc.size)) continue;
+        std::string_view key, value;
+        if (parseRecord(record.data(), record.size(), key, value)) {
+            fn(std::string(key), std::string(value));
+        }
+    }
+}
+
+size_t TierLog::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return index_.size();
+}
+
+uint64_t TierLog::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+bool TierLog::reclaim(double min_live_ratio, uint64_t max_bytes) {
+    std::shared_ptr<Segment> victim;
+    bool drop = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (segments_.size() < 2) return false;  // Only the active segment
+
+        if (bytes_ > max_bytes) {
+            // Over budget: the oldest entries leave the tier
+            victim = segments_.begin()->second;
+            drop = true;
+        } else {
+            double lowest = min_live_ratio;
+            for (auto it = segments_.begin(); std::next(it) != segments_.end(); ++it) {
+                double ratio = it->second->size ? static_cast<double>(it->second->live) / it->second->size : 0;
+                if (ratio < lowest) {
+                    lowest = ratio;
+                    victim = it->second;
+                }
+            }
+        }
+    }
+    if (!victim) return false;
+
+    // Sealed segments are immutable, so the read needs no lock
+    std::string data(victim->size, '\0');
+    if (pread(victim->fd, data.data(), data.size(), 0) != static_cast<ssize_t>(data.size())) {
+        data.clear();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t offset = 0;
+    std::string_view key, value;
+    while (offset < data.size() && parseRecord(data.data() + offset, data.size() - offset, key, value)) {
+        size_t record_size = sizeof(RecordHeader) + key.size() + value.size();
+        std::string key_str(key);
+        auto it = index_.find(hashKey(key_str));
+
+        // Only records the index still points at are live
+        if (it != index_.end() && sameLocation(it->second, Location{victim->id, static_cast<uint32_t>(offset), 0})) {
+            if (drop) {
+                index_.erase(it);
+            } else {
+                appendLocked(key_str, std::string(value));
+            }
+        }
+        offset += record_size;
+    }
+
+    // Anything still indexed in the victim (e.g. a failed read) is lost with it
+    for (auto it = index_.begin(); it != index_.end();) {
+        it = it->second.segment == victim->id ? index_.erase(it) : std::next(it);
+    }
+
+    bytes_ -= victim->size;
+    segments_.erase(victim->id);
+    unlink(victim->path.c_str());
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// SsdTier
+// ---------------------------------------------------------------------------
+
+SsdTier::SsdTier(const std::string& dir, size_t num_logs, const Options& options)
+    : options_(options), running_(true) {
+    std::filesystem::create_directories(dir);
+
+    // The index is not persisted, so segments left by a previous process are useless
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.path().extension() == ".tier") {
+            std::filesystem::remove(entry.path());
+        }
+    }
+
+    for (size_t i = 0; i < num_logs; ++i) {
+        logs_.push_back(std::make_unique<TierLog>(dir + "/shard" + std::to_string(i), options_.segment_bytes));
+    }
+    reclaimer_ = std::thread(&SsdTier::reclaimLoop, this);
+}
+
+SsdTier::~SsdTier() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cv_.notify_all();
+    if (reclaimer_.joinable()) {
+        reclaimer_.join();
+    }
+}
+
+void SsdTier::reclaimLoop() {
+    uint64_t max_bytes_per_log = options_.max_bytes / std::max<size_t>(logs_.size(), 1);
+    while (running_) {
+        bool busy = false;
+        for (auto& log : logs_) {
+            busy |= log->reclaim(options_.min_live_ratio, max_bytes_per_log);
+        }
+        if (!busy) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait_for(lock, std::chrono::milliseconds(options_.reclaim_interval_ms), [this] { return !running_; });
+        }
+    }
+}
+
+SsdTier::Stats SsdTier::stats() const {
+    Stats total;
+    for (const auto& log : logs_) {
+        total.hits += log->stats().hits;
+        total.misses += log->stats().misses;
+        total.read_ns += log->stats().read_ns;
+        total.entries += log->size();
+        total.bytes += log->bytes();
+    }
+    return total;
+}
+
+// ---------------------------------------------------------------------------
+// TieredShard
+// ---------------------------------------------------------------------------
+
+TieredShard::TieredShard(size_t capacity, TierLog& log) : memory_(capacity), log_(log) {
+    memory_.setEvictionListener([this](const std::string& key, const std::string& value) { log_.put(key, value); });
+}
+
+std::optional<std::pair<std::string, uint64_t>> TieredShard::promoteLocked(std::unique_lock<std::mutex>& lock,
+                                                                           const std::string& key, bool count_miss) {
+    // A concurrent write or reclaim may move the record while the lock is released; look again then
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        auto loc = attempt == 0 && count_miss ? log_.lookup(key) : log_.find(key);
+        if (!loc) return std::nullopt;
+
+        lock.unlock();
+        auto value = log_.read(key, *loc);
+        lock.lock();
+
+        // Another request may have brought the key into memory meanwhile
+        if (memory_.exists(key)) return memory_.getVersioned(key);
+
+        if (!value) {
+            auto now = log_.find(key);
+            if (now && sameLocation(*now, *loc)) return std::nullopt;  // Another key's record (hash collision)
+            continue;
+        }
+        if (!log_.eraseAt(key, *loc)) continue;
+
+        uint64_t version = memory_.update(key, [&value](const std::string*, uint64_t) { return value; });
+        return std::make_pair(std::move(*value), version);
+    }
+    return std::nullopt;
+}
+
+void TieredShard::put(const std::string& key, const std::string& value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    log_.erase(key);
+    memory_.put(key, value);
+}
+
+std::optional<std::string> TieredShard::get(const std::string& key) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (auto value = memory_.get(key)) return value;
+    if (auto promoted = promoteLocked(lock, key)) return std::move(promoted->first);
+    return std::nullopt;
+}
+
+std::optional<std::pair<std::string, uint64_t>> TieredShard::getVersioned(const std::string& key) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (auto value = memory_.getVersioned(key)) return value;
+    return promoteLocked(lock, key);
+}
+
+bool TieredShard::exists(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return memory_.exists(key) || log_.find(key).has_value();
+}
+
+bool TieredShard::remove(const std::string& key) {
+    return remove(key, [] {});
+}
+
+void TieredShard::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    memory_.clear();
+    log_.clear();
+}
+
+size_t TieredShard::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return memory_.size() + log_.size();
+}
+
+TieredShard::Stats TieredShard::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto stats = memory_.getStats();
+    return Stats{stats.hits, stats.misses};
+}
+
+}  // namespace kvcache
@@ -6,23 +6,176 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <condition_variable>
 #include <cstring>
 #include <iostream>
 #include <vector>
 
+#include "numa.h"
+#include "protocol.h"
+
 namespace kvcache {
 
 constexpr int MAX_EVENTS = 64;
 constexpr int BUFFER_SIZE = 4096;
+// A client that stops reading is dropped once this much output is queued for it
+constexpr size_t MAX_PENDING_BYTES = 64 << 20;
+// Marks the epoll registration of a connection's write_fd; the low bits hold its fd
+constexpr uint64_t WRITE_TAG = uint64_t{1} << 32;
+// How long runOnLanes waits for another lane's worker before running the task itself
+constexpr auto LANE_HANDOFF_TIMEOUT = std::chrono::milliseconds(1);
+
+thread_local size_t current_lane = SIZE_MAX;  // Lane of the calling worker, if it is one
+
+namespace {
+
+// Sends as much of [data, data + size) as the socket takes without blocking. Returns false
+// on a connection error.
+bool sendSome(int fd, const uint8_t* data, size_t size, size_t& sent) {
+    while (sent < size) {
+        ssize_t n = send(fd, data + sent, size - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+    return true;
+}
+
+// Moves the complete frames at the front of buffer into frames. Stops at a partial frame,
+// at bytes that are not a frame of a known version, at a v2 frame without FLAG_ORDERED,
+// which processBuffer runs out of order on the pool, and at a frame batchable rejects.
+size_t takeFrames(std::vector<uint8_t>& buffer, const TcpServer::Batchable& batchable,
+                  std::vector<std::vector<uint8_t>>& frames) {
+    size_t pos = 0, taken = 0;
+    while (buffer.size() - pos >= HEADER_SIZE) {
+        Header header = Message::decodeHeader(buffer.data() + pos);
+        if (header.magic != MAGIC || header.version > MAX_VERSION) break;
+        size_t header_len = Message::headerSize(header);
+        if (buffer.size() - pos < header_len) break;
+        if (header.version >= VERSION_2 && !(Message::decodeExt(buffer.data() + pos).flags & FLAG_ORDERED)) break;
+        size_t total_len = header_len + header.key_len + header.value_len;
+        if (buffer.size() - pos < total_len) break;
+
+        std::vector<uint8_t> frame(buffer.begin() + pos, buffer.begin() + pos + total_len);
+        if (!batchable(frame)) break;
+        frames.push_back(std::move(frame));
+        pos += total_len;
+        ++taken;
+    }
+    buffer.erase(buffer.begin(), buffer.begin() + pos);
+    return taken;
+}
+
+}  // namespace
+
+Connection::~Connection() {
+    if (write_fd != -1) close(write_fd);
+    if (fd != -1) close(fd);
+}
 
 TcpServer::TcpServer(int port, int thread_pool_size)
-    : port_(port), server_fd_(-1), epoll_fd_(-1), running_(false), thread_pool_(thread_pool_size) {}
+    : TcpServer(port, std::vector<Lane>{Lane{-1, {}, static_cast<size_t>(std::max(thread_pool_size, 1))}}) {}
+
+TcpServer::TcpServer(int port, std::vector<Lane> lanes) : port_(port), server_fd_(-1), running_(false) {
+    if (lanes.empty()) lanes.emplace_back();
+    for (auto& config : lanes) {
+        auto lane = std::make_unique<LaneState>();
+        lane->config = std::move(config);
+        const Lane& c = lane->config;
+        size_t index = lanes_.size();
+        lane->pool = std::make_unique<ThreadPool>(std::max<size_t>(c.workers, 1), [this, &c, index](size_t i) {
+            current_lane = index;
+            pin(c, i);
+        });
+        lanes_.push_back(std::move(lane));
+    }
+
+    if (lanes_.size() > 1) {
+        NumaTopology topology = NumaTopology::detect();
+        for (const auto& node : topology.nodes()) {
+            for (int cpu : node.cpus) {
+                if (static_cast<size_t>(cpu) >= cpu_nodes_.size()) cpu_nodes_.resize(cpu + 1, -1);
+                cpu_nodes_[cpu] = node.id;
+            }
+        }
+    }
+}
+
+TcpServer::~TcpServer() {
+    stop();
+    lanes_.clear();  // Drain the workers while the handler is still alive
+}
 
-TcpServer::~TcpServer() { stop(); }
+void TcpServer::pin(const Lane& lane, size_t index) {
+    if (lane.cpus.empty()) return;
+    if (pinThread(lane.cpus[index % lane.cpus.size()])) {
+        pinned_threads_++;
+    }
+}
 
 void TcpServer::setHandler(Handler handler) { handler_ = std::move(handler); }
 
+void TcpServer::setAsyncHandler(AsyncHandler handler) { async_handler_ = std::move(handler); }
+
+void TcpServer::setBatchHandler(BatchHandler handler, Batchable batchable) {
+    batch_handler_ = std::move(handler);
+    batchable_ = std::move(batchable);
+}
+
+void TcpServer::runOnLanes(std::vector<LaneTask> tasks) const {
+    // Shared with the queued hand-offs, which may run after this call has returned
+    struct State {
+        std::vector<LaneTask> tasks;
+        std::unique_ptr<std::atomic<bool>[]> claimed;
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t done = 0;
+    };
+    auto state = std::make_shared<State>();
+    state->tasks = std::move(tasks);
+    size_t count = state->tasks.size();
+    state->claimed = std::make_unique<std::atomic<bool>[]>(count);
+
+    auto run = [state](size_t i) {
+        if (state->claimed[i].exchange(true)) return;
+        state->tasks[i].second();
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            ++state->done;
+        }
+        state->cv.notify_all();
+    };
+
+    // Hand off first, so the other lanes work while the caller runs its own tasks
+    for (size_t i = 0; i < count; ++i) {
+        size_t lane = state->tasks[i].first;
+        if (lane != current_lane && lane < lanes_.size()) {
+            lanes_[lane]->pool->enqueue([run, i]() { run(i); });
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        size_t lane = state->tasks[i].first;
+        if (lane == current_lane || lane >= lanes_.size()) run(i);
+    }
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    if (!state->cv.wait_for(lock, LANE_HANDOFF_TIMEOUT, [&] { return state->done == count; })) {
+        lock.unlock();
+        for (size_t i = 0; i < count; ++i) {
+            run(i);  // Still queued behind busy workers
+        }
+        lock.lock();
+        state->cv.wait(lock, [&] { return state->done == count; });
+    }
+}
+
 void TcpServer::setNonBlocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
     if (flags == -1) return;
@@ -51,40 +204,87 @@ void TcpServer::start() {
         throw std::runtime_error("Failed to listen");
     }
 
-    epoll_fd_ = epoll_create1(0);
-    if (epoll_fd_ < 0) {
-        throw std::runtime_error("Failed to create epoll");
+    for (auto& lane : lanes_) {
+        lane->epoll_fd = epoll_create1(0);
+        if (lane->epoll_fd < 0) {
+            throw std::runtime_error("Failed to create epoll");
+        }
     }
 
+    // The first lane's loop accepts for all lanes
     epoll_event event{};
     event.events = EPOLLIN;
     event.data.fd = server_fd_;
-    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, server_fd_, &event) < 0) {
+    if (epoll_ctl(lanes_[0]->epoll_fd, EPOLL_CTL_ADD, server_fd_, &event) < 0) {
         throw std::runtime_error("Failed to add server socket to epoll");
     }
 
     running_ = true;
     std::cout << "Server started on port " << port_ << std::endl;
-    eventLoop();
+    for (size_t i = 1; i < lanes_.size(); ++i) {
+        LaneState* lane = lanes_[i].get();
+        lane->loop = std::thread([this, lane]() {
+            pin(lane->config, 0);
+            eventLoop(*lane);
+        });
+    }
+    pin(lanes_[0]->config, 0);
+    eventLoop(*lanes_[0]);
 }
 
 void TcpServer::stop() {
     running_ = false;
+    for (auto& lane : lanes_) {
+        if (lane->loop.joinable() && lane->loop.get_id() != std::this_thread::get_id()) {
+            lane->loop.join();
+        }
+    }
     if (server_fd_ != -1) {
         close(server_fd_);
         server_fd_ = -1;
     }
-    if (epoll_fd_ != -1) {
-        close(epoll_fd_);
-        epoll_fd_ = -1;
+    for (auto& lane : lanes_) {
+        if (lane->epoll_fd != -1) {
+            close(lane->epoll_fd);
+            lane->epoll_fd = -1;
+        }
+    }
+}
+
+std::vector<TcpServer::LaneStats> TcpServer::laneStats() const {
+    std::vector<LaneStats> stats;
+    for (const auto& lane : lanes_) {
+        stats.push_back(
+            LaneStats{lane->config.node, lane->config.cpus, lane->connections.load(), lane->accepted.load()});
+    }
+    return stats;
+}
+
+// The lane on the NUMA node whose CPU received the connection's packets, so the socket
+// buffers and the threads serving them share a node. Round robin when that is unknown.
+size_t TcpServer::pickLane(int client_fd) {
+    if (lanes_.size() == 1) return 0;
+
+    int cpu = -1;
+    socklen_t len = sizeof(cpu);
+    if (getsockopt(client_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 && cpu >= 0 &&
+        static_cast<size_t>(cpu) < cpu_nodes_.size() && cpu_nodes_[cpu] >= 0) {
+        // Several lanes on the node share its connections
+        std::vector<size_t> local;
+        for (size_t i = 0; i < lanes_.size(); ++i) {
+            if (lanes_[i]->config.node == cpu_nodes_[cpu]) local.push_back(i);
+        }
+        if (!local.empty()) return local[next_lane_++ % local.size()];
     }
+    return next_lane_++ % lanes_.size();
 }
 
-void TcpServer::eventLoop() {
+void TcpServer::eventLoop(LaneState& lane) {
     std::vector<epoll_event> events(MAX_EVENTS);
+    std::vector<int> ready;
 
     while (running_) {
-        int n = epoll_wait(epoll_fd_, events.data(), MAX_EVENTS, 1000);
+        int n = epoll_wait(lane.epoll_fd, events.data(), MAX_EVENTS, 1000);
         if (n < 0) {
             if (errno == EINTR) continue;
             break;
@@ -93,11 +293,19 @@ void TcpServer::eventLoop() {
         for (int i = 0; i < n; ++i) {
             if (events[i].data.fd == server_fd_) {
                 handleNewConnection();
+            } else if (events[i].data.u64 & WRITE_TAG) {
+                handleWritable(lane, static_cast<int>(events[i].data.u64 & ~WRITE_TAG));
+            } else if (batch_handler_) {
+                ready.push_back(events[i].data.fd);
             } else {
                 int client_fd = events[i].data.fd;
-                handleClientData(client_fd);
+                handleClientData(lane, client_fd);
             }
         }
+        if (!ready.empty()) {
+            handleRound(lane, std::move(ready));
+            ready.clear();
+        }
     }
 }
 
@@ -110,27 +318,36 @@ void TcpServer::handleNewConnection() {
 
     setNonBlocking(client_fd);
 
+    size_t index = pickLane(client_fd);
+    LaneState& lane = *lanes_[index];
     {
         std::lock_guard<std::mutex> lock(connections_mutex_);
         auto conn = std::make_shared<Connection>();
         conn->fd = client_fd;
+        conn->lane = index;
         connections_[client_fd] = conn;
     }
+    lane.connections++;
+    lane.accepted++;
 
     epoll_event event{};
     event.events = EPOLLIN | EPOLLET | EPOLLONESHOT;
     event.data.fd = client_fd;
-    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client_fd, &event);
+    epoll_ctl(lane.epoll_fd, EPOLL_CTL_ADD, client_fd, &event);
 }
 
 void TcpServer::removeConnection(int fd) {
     std::lock_guard<std::mutex> lock(connections_mutex_);
-    connections_.erase(fd);
-    close(fd);
+    auto it = connections_.find(fd);
+    if (it == connections_.end()) return;
+    lanes_[it->second->lane]->connections--;
+    // Closed by ~Connection once in-flight requests let go of it
+    shutdown(fd, SHUT_RDWR);
+    connections_.erase(it);
 }
 
-void TcpServer::handleClientData(int client_fd) {
-    thread_pool_.enqueue([this, client_fd]() {
+void TcpServer::handleClientData(LaneState& lane, int client_fd) {
+    lane.pool->enqueue([this, &lane, client_fd]() {
         std::shared_ptr<Connection> conn;
         {
             std::lock_guard<std::mutex> lock(connections_mutex_);
@@ -140,58 +357,257 @@ void TcpServer::handleClientData(int client_fd) {
         }
 
         std::lock_guard<std::mutex> conn_lock(conn->mutex);
+        if (!readAvailable(*conn)) {
+            removeConnection(client_fd);
+            return;
+        }
 
-        std::array<char, BUFFER_SIZE> buffer;
-        bool closed = false;
+        // Process buffer
+        if ((handler_ || async_handler_) && !conn->stalled) {
+            processBuffer(conn);
+        }
 
-        // Read all available data (Edge Triggered)
-        while (true) {
-            ssize_t count = read(client_fd, buffer.data(), BUFFER_SIZE);
-            if (count < 0) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
-                closed = true;
-                break;
+        rearm(lane, client_fd);
+    });
+}
+
+// One pool task for every connection of an epoll_wait round, so the batch handler can
+// group their requests. The connections are re-armed only after their replies are sent,
+// which keeps each connection's requests in order across rounds.
+void TcpServer::handleRound(LaneState& lane, std::vector<int> client_fds) {
+    lane.pool->enqueue([this, &lane, client_fds = std::move(client_fds)]() {
+        struct Part {
+            std::shared_ptr<Connection> conn;
+            size_t first;
+            size_t count;
+        };
+        std::vector<Part> parts;
+        std::vector<std::vector<uint8_t>> frames;
+        std::vector<size_t> starts;
+
+        for (int client_fd : client_fds) {
+            std::shared_ptr<Connection> conn;
+            {
+                std::lock_guard<std::mutex> lock(connections_mutex_);
+                auto it = connections_.find(client_fd);
+                if (it == connections_.end()) continue;  // Already removed
+                conn = it->second;
+            }
+
+            std::lock_guard<std::mutex> conn_lock(conn->mutex);
+            if (!readAvailable(*conn)) {
+                removeConnection(client_fd);
+                continue;
+            }
+            // Frames behind in-flight v2 requests keep waiting for them in processBuffer
+            size_t first = frames.size();
+            size_t count = conn->inflight == 0 ? takeFrames(conn->read_buffer, batchable_, frames) : 0;
+            if (count > 0) starts.push_back(first);
+            parts.push_back(Part{std::move(conn), first, count});
+        }
+
+        std::vector<std::vector<uint8_t>> replies;
+        if (!frames.empty()) replies = batch_handler_(frames, starts);
+
+        for (const auto& part : parts) {
+            if (part.count > 0) {
+                // One send per connection for all of its replies
+                std::vector<uint8_t> out;
+                for (size_t i = part.first; i < part.first + part.count; ++i) {
+                    out.insert(out.end(), replies[i].begin(), replies[i].end());
+                }
+                sendResponse(*part.conn, out);
+            }
+            bool rest;
+            {
+                std::lock_guard<std::mutex> conn_lock(part.conn->mutex);
+                rest = (handler_ || async_handler_) && !part.conn->stalled && !part.conn->read_buffer.empty();
+            }
+            if (!rest) {
+                rearm(lane, part.conn->fd);
+                continue;
+            }
+            // Frames that were not batched run on a task of their own, so a slow one does
+            // not hold up the other connections of the round
+            lane.pool->enqueue([this, &lane, conn = part.conn]() {
+                {
+                    std::lock_guard<std::mutex> conn_lock(conn->mutex);
+                    if (!conn->stalled) processBuffer(conn);
+                }
+                rearm(lane, conn->fd);
+            });
+        }
+    });
+}
+
+// Reads all available data (edge triggered). Returns false once the peer is gone.
+bool TcpServer::readAvailable(Connection& conn) {
+    std::array<char, BUFFER_SIZE> buffer;
+    while (true) {
+        ssize_t count = read(conn.fd, buffer.data(), BUFFER_SIZE);
+        if (count < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        if (count == 0) {
+            return false;
+        }
+        conn.read_buffer.insert(conn.read_buffer.end(), buffer.begin(), buffer.begin() + count);
+    }
+}
+
+// Re-arm EPOLLONESHOT
+void TcpServer::rearm(LaneState& lane, int client_fd) {
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLET | EPOLLONESHOT;
+    event.data.fd = client_fd;
+    epoll_ctl(lane.epoll_fd, EPOLL_CTL_MOD, client_fd, &event);
+}
+
+// Called with conn->mutex held. v2 requests without FLAG_ORDERED are handed to the pool
+// and answered as they finish; any other request waits until those have drained.
+void TcpServer::processBuffer(const std::shared_ptr<Connection>& conn) {
+    auto& buffer = conn->read_buffer;
+    while (!buffer.empty()) {
+        if (buffer.size() >= HEADER_SIZE + HEADER_EXT_SIZE) {
+            Header header = Message::decodeHeader(buffer.data());
+            if (header.magic == MAGIC && header.version == VERSION_2 &&
+                !(Message::decodeExt(buffer.data()).flags & FLAG_ORDERED)) {
+                size_t total_len = Message::headerSize(header) + header.key_len + header.value_len;
+                if (buffer.size() < total_len) break;
+
+                std::vector<uint8_t> frame(buffer.begin(), buffer.begin() + total_len);
+                buffer.erase(buffer.begin(), buffer.begin() + total_len);
+                ++conn->inflight;
+                lanes_[conn->lane]->pool->enqueue([this, conn, frame = std::move(frame)]() mutable {
+                    runRequest(std::move(conn), std::move(frame));
+                });
+                continue;
             }
-            if (count == 0) {
-                closed = true;
+        }
+
+        if (conn->inflight > 0) {
+            // Resumed by the last in-flight request
+            conn->stalled = true;
+            break;
+        }
+
+        size_t consumed = 0;
+        if (async_handler_) {
+            // In flight until the reply, so the connection's next requests wait for it
+            ++conn->inflight;
+            callAsync(conn, buffer, consumed);
+            if (consumed == 0) {
+                --conn->inflight;  // Not enough data; no reply comes
                 break;
             }
-            conn->read_buffer.insert(conn->read_buffer.end(), buffer.begin(), buffer.begin() + count);
+            buffer.erase(buffer.begin(), buffer.begin() + consumed);
+            continue;
         }
+        auto response = handler_(buffer, consumed);
+        if (consumed == 0) break;  // Not enough data
 
-        if (closed) {
-            removeConnection(client_fd);
+        buffer.erase(buffer.begin(), buffer.begin() + consumed);
+        sendResponse(*conn, response);
+    }
+}
+
+void TcpServer::runRequest(std::shared_ptr<Connection> conn, std::vector<uint8_t> frame) {
+    size_t consumed = 0;
+    if (async_handler_) {
+        callAsync(conn, frame, consumed);  // The reply releases inflight
+        return;
+    }
+    sendResponse(*conn, handler_(frame, consumed));
+    finishRequest(conn);
+}
+
+// The caller has counted the request in inflight. The reply may come on any thread, even
+// inside the handler while conn->mutex is held, so inflight is released from the pool.
+void TcpServer::callAsync(const std::shared_ptr<Connection>& conn, const std::vector<uint8_t>& data,
+                          size_t& consumed) {
+    async_handler_(data, consumed, [this, conn](const std::vector<uint8_t>& response) {
+        sendResponse(*conn, response);
+        lanes_[conn->lane]->pool->enqueue([this, conn]() { finishRequest(conn); });
+    });
+}
+
+void TcpServer::finishRequest(const std::shared_ptr<Connection>& conn) {
+    std::lock_guard<std::mutex> lock(conn->mutex);
+    if (--conn->inflight == 0 && conn->stalled) {
+        conn->stalled = false;
+        processBuffer(conn);
+    }
+}
+
+// Never blocks: what the socket does not take now is queued and flushed once it turns
+// writable, so a client that stops reading holds up no worker and no other connection.
+// Queued bytes always go out before newer replies, so frames are never cut short.
+void TcpServer::sendResponse(Connection& conn, const std::vector<uint8_t>& response) {
+    std::lock_guard<std::mutex> lock(conn.write_mutex);
+    if (conn.broken) return;
+
+    size_t sent = 0;
+    if (conn.pending.empty()) {
+        if (!sendSome(conn.fd, response.data(), response.size(), sent)) {
+            dropBroken(conn);
             return;
         }
+        if (sent == response.size()) return;
+    }
 
-        // Process buffer
-        if (handler_) {
-            while (!conn->read_buffer.empty()) {
-                size_t consumed = 0;
-                auto response = handler_(conn->read_buffer, consumed);
-
-                if (consumed > 0) {
-                    // Remove consumed bytes
-                    conn->read_buffer.erase(conn->read_buffer.begin(), conn->read_buffer.begin() + consumed);
-
-                    if (!response.empty()) {
-                        // Write response
-                        // TODO: Handle partial writes properly
-                        send(client_fd, response.data(), response.size(), 0);
-                    }
-                } else {
-                    // Not enough data
-                    break;
-                }
-            }
+    bool idle = conn.pending.empty();
+    conn.pending.insert(conn.pending.end(), response.begin() + sent, response.end());
+    if (conn.pending.size() > MAX_PENDING_BYTES) {
+        dropBroken(conn);
+    } else if (idle) {
+        armWrite(conn);
+    }
+}
+
+void TcpServer::handleWritable(LaneState& lane, int client_fd) {
+    lane.pool->enqueue([this, client_fd]() {
+        std::shared_ptr<Connection> conn;
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex_);
+            auto it = connections_.find(client_fd);
+            if (it == connections_.end()) return;  // Already removed
+            conn = it->second;
         }
 
-        // Re-arm EPOLLONESHOT
-        epoll_event event{};
-        event.events = EPOLLIN | EPOLLET | EPOLLONESHOT;
-        event.data.fd = client_fd;
-        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, client_fd, &event);
+        std::lock_guard<std::mutex> lock(conn->write_mutex);
+        if (conn->broken || conn->pending.empty()) return;
+        size_t sent = 0;
+        if (!sendSome(conn->fd, conn->pending.data(), conn->pending.size(), sent)) {
+            dropBroken(*conn);
+            return;
+        }
+        conn->pending.erase(conn->pending.begin(), conn->pending.begin() + sent);
+        if (!conn->pending.empty()) armWrite(*conn);
     });
 }
 
+// Called with write_mutex held. The read side keeps its own EPOLLIN registration on fd, so
+// EPOLLOUT is polled on a dup of it.
+void TcpServer::armWrite(Connection& conn) {
+    int epoll_fd = lanes_[conn.lane]->epoll_fd;
+    epoll_event event{};
+    event.events = EPOLLOUT | EPOLLONESHOT;
+    event.data.u64 = WRITE_TAG | static_cast<uint32_t>(conn.fd);
+    if (conn.write_fd == -1) {
+        conn.write_fd = dup(conn.fd);
+        if (conn.write_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn.write_fd, &event) < 0) {
+            dropBroken(conn);
+        }
+        return;
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.write_fd, &event);
+}
+
+// Called with write_mutex held
+void TcpServer::dropBroken(Connection& conn) {
+    conn.broken = true;
+    conn.pending.clear();
+    removeConnection(conn.fd);
+}
+
 }  // namespace kvcache
@@ -1,6 +1,7 @@
 #include <benchmark/benchmark.h>
 
 #include <random>
+#include <shared_mutex>
 #include <string>
 #include <thread>
 #include <vector>
@@ -60,4 +61,95 @@ static void BM_ShardedCache_Concurrent(benchmark::State& state) {
 BENCHMARK(BM_LRUCache_Concurrent)->Threads(1)->Threads(4)->Threads(8)->Threads(16);
 BENCHMARK(BM_ShardedCache_Concurrent)->Threads(1)->Threads(4)->Threads(8)->Threads(16);
 
+// Policy combinations side by side: 80% GET / 20% PUT over strided integer keys,
+// the pattern where an unmixed identity hash piles everything onto one shard
+template <typename Cache>
+static void BM_ShardedCache_Policy(benchmark::State& state) {
+    static Cache cache(100000, 16);
+    std::mt19937 gen(state.thread_index());
+    std::uniform_int_distribution<> dis(0, 100000 / 16);
+
+    for (auto _ : state) {
+        int key = dis(gen) * 16;
+        if (gen() % 5 == 0) {
+            cache.put(key, key);
+        } else {
+            benchmark::DoNotOptimize(cache.get(key));
+        }
+    }
+}
+
+using Default = ShardedCache<int, int>;
+using Identity = ShardedCache<int, int, std::hash<int>, LruEviction, std::mutex, IdentityMixer>;
+using Fifo = ShardedCache<int, int, std::hash<int>, FifoEviction>;
+using SharedMutex = ShardedCache<int, int, std::hash<int>, LruEviction, std::shared_mutex>;
+using Spin = ShardedCache<int, int, std::hash<int>, LruEviction, SpinLock>;
+using SpinFifo = ShardedCache<int, int, std::hash<int>, FifoEviction, SpinLock>;
+
+BENCHMARK_TEMPLATE(BM_ShardedCache_Policy, Default)->Threads(1)->Threads(8);
+BENCHMARK_TEMPLATE(BM_ShardedCache_Policy, Identity)->Threads(1)->Threads(8);
+BENCHMARK_TEMPLATE(BM_ShardedCache_Policy, Fifo)->Threads(1)->Threads(8);
+BENCHMARK_TEMPLATE(BM_ShardedCache_Policy, SharedMutex)->Threads(1)->Threads(8);
+BENCHMARK_TEMPLATE(BM_ShardedCache_Policy, Spin)->Threads(1)->Threads(8);
+BENCHMARK_TEMPLATE(BM_ShardedCache_Policy, SpinFifo)->Threads(1)->Threads(8);
+
+// Single-threaded owner: no locking at all
+using Unlocked = ShardedCache<int, int, std::hash<int>, LruEviction, NullLock>;
+BENCHMARK_TEMPLATE(BM_ShardedCache_Policy, Unlocked)->Threads(1);
+
+// Every GET hits one key: a single shard lock serializes all readers unless the key
+// is served from per-thread hot-key copies
+template <bool HotKeys>
+static void BM_ShardedCache_SingleHotKey(benchmark::State& state) {
+    static ShardedCache<int, int> cache = [] {
+        ShardedCache<int, int> c(100000, 16);
+        if (HotKeys) c.enableHotKeys();
+        c.put(42, 42);
+        return c;
+    }();
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cache.get(42));
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_ShardedCache_SingleHotKey, false)->Threads(1)->Threads(8);
+BENCHMARK_TEMPLATE(BM_ShardedCache_SingleHotKey, true)->Threads(1)->Threads(8);
+
+// GETs of one event-loop round: one lock acquisition per request, or one per shard with
+// the round grouped by shard and each group's buckets prefetched
+template <bool Grouped>
+static void BM_ShardedCache_RoundOfGets(benchmark::State& state) {
+    static ShardedCache<int, int> cache = [] {
+        ShardedCache<int, int> c(100000, 16);
+        for (int i = 0; i < 100000; ++i) c.put(i, i);
+        return c;
+    }();
+
+    std::mt19937 gen(state.thread_index());
+    std::uniform_int_distribution<> dist(0, 99999);
+    std::vector<int> round(state.range(0));
+    std::vector<std::vector<int>> groups(cache.numShards());
+
+    for (auto _ : state) {
+        for (auto& key : round) key = dist(gen);
+        if constexpr (Grouped) {
+            for (int key : round) groups[cache.shardIndex(key)].push_back(key);
+            for (size_t shard = 0; shard < groups.size(); ++shard) {
+                cache.withShard(shard, [&](auto& batch) {
+                    for (int key : groups[shard]) batch.prefetch(key);
+                    for (int key : groups[shard]) benchmark::DoNotOptimize(batch.get(key));
+                });
+                groups[shard].clear();
+            }
+        } else {
+            for (int key : round) benchmark::DoNotOptimize(cache.get(key));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * round.size());
+}
+
+BENCHMARK_TEMPLATE(BM_ShardedCache_RoundOfGets, false)->Arg(256)->Threads(1)->Threads(8);
+BENCHMARK_TEMPLATE(BM_ShardedCache_RoundOfGets, true)->Arg(256)->Threads(1)->Threads(8);
+
 BENCHMARK_MAIN();
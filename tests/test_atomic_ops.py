@@ -0,0 +1,75 @@
+import socket
+import struct
+import sys
+
+MAGIC = 0xCAFE
+VERSION = 1
+CMD_SET = 1
+CMD_GET = 2
+CMD_INCR = 8
+CMD_DECR = 9
+CMD_APPEND = 10
+CMD_GETS = 11
+CMD_CAS = 12
+
+
+def encode_msg(cmd, key, value=""):
+    key_bytes = key.encode()
+    value_bytes = value.encode()
+    header = struct.pack("!HBBII", MAGIC, VERSION, cmd, len(key_bytes), len(value_bytes))
+    return header + key_bytes + value_bytes
+
+
+def recv_exact(s, n):
+    data = b""
+    while len(data) < n:
+        chunk = s.recv(n - len(data))
+        if not chunk:
+            break
+        data += chunk
+    return data
+
+
+def send_cmd(port, cmd, key, value=""):
+    s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    s.connect(("localhost", port))
+    s.sendall(encode_msg(cmd, key, value))
+
+    magic, version, resp_cmd, key_len, val_len = struct.unpack("!HBBII", recv_exact(s, 12))
+    body = recv_exact(s, key_len + val_len)
+    s.close()
+    return body[key_len:].decode()
+
+
+def test_atomic_ops(port):
+    print("INCR/DECR...")
+    send_cmd(port, CMD_SET, "counter", "10")
+    assert send_cmd(port, CMD_INCR, "counter") == "11"
+    assert send_cmd(port, CMD_INCR, "counter", "5") == "16"
+    assert send_cmd(port, CMD_DECR, "counter", "20") == "-4"
+    assert send_cmd(port, CMD_INCR, "fresh_counter") == "1"
+    send_cmd(port, CMD_SET, "text", "abc")
+    assert send_cmd(port, CMD_INCR, "text").startswith("ERR")
+
+    print("APPEND...")
+    send_cmd(port, CMD_SET, "log", "a")
+    assert send_cmd(port, CMD_APPEND, "log", "bc") == "3"
+    assert send_cmd(port, CMD_GET, "log") == "abc"
+
+    print("GETS/CAS...")
+    send_cmd(port, CMD_SET, "config", "v1")
+    version, value = send_cmd(port, CMD_GETS, "config").split(" ", 1)
+    assert value == "v1"
+    new_version = send_cmd(port, CMD_CAS, "config", f"{version} v2")
+    assert new_version.isdigit() and int(new_version) > int(version)
+    # The old version is stale now
+    assert send_cmd(port, CMD_CAS, "config", f"{version} v3") == "EXISTS"
+    assert send_cmd(port, CMD_GET, "config") == "v2"
+    assert send_cmd(port, CMD_CAS, "missing_key", "1 x") == "NOT_FOUND"
+
+    print("SUCCESS: Atomic commands work!")
+
+
+if __name__ == "__main__":
+    PORT = int(sys.argv[1]) if len(sys.argv) > 1 else 8080
+    test_atomic_ops(PORT)
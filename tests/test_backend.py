@@ -0,0 +1,70 @@
+import os
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+from test_replication import CMD_DEL, CMD_GET, CMD_SET, CMD_STATS, send_cmd, wait_for_port
+
+PORT = 8094
+
+
+def test_backend(server_bin):
+    workdir = tempfile.mkdtemp()
+    backend_dir = os.path.join(workdir, "backend")
+    os.mkdir(backend_dir)
+    for i in range(10):
+        with open(os.path.join(backend_dir, f"key{i}"), "w") as f:
+            f.write(f"value{i}")
+
+    proc = subprocess.Popen(
+        [server_bin, str(PORT), "--backend-dir", backend_dir, "--backend-negative-ttl-ms", "500"],
+        cwd=workdir,
+        stdout=subprocess.DEVNULL,
+    )
+    try:
+        wait_for_port(PORT)
+
+        # Concurrent misses on one key load it once
+        results = []
+        threads = [
+            threading.Thread(target=lambda: results.append(send_cmd(PORT, CMD_GET, "key0"))) for _ in range(8)
+        ]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        assert results == ["value0"] * 8, results
+        for i in range(1, 10):
+            assert send_cmd(PORT, CMD_GET, f"key{i}") == f"value{i}"
+        assert "Loads: 10," in send_cmd(PORT, CMD_STATS, "")
+        print("Read-through: OK")
+
+        # "Not found" is remembered briefly, then asked again
+        assert send_cmd(PORT, CMD_GET, "late") == ""
+        with open(os.path.join(backend_dir, "late"), "w") as f:
+            f.write("arrived")
+        assert send_cmd(PORT, CMD_GET, "late") == ""
+        time.sleep(0.6)
+        assert send_cmd(PORT, CMD_GET, "late") == "arrived"
+        print("Negative caching: OK")
+
+        # Writes go to the cache only; a deleted key is loaded again
+        send_cmd(PORT, CMD_SET, "key1", "written")
+        assert send_cmd(PORT, CMD_GET, "key1") == "written"
+        send_cmd(PORT, CMD_DEL, "key1")
+        assert send_cmd(PORT, CMD_GET, "key1") == "value1"
+
+        stats = send_cmd(PORT, CMD_STATS, "")
+        print(f"Stats: {stats}")
+        assert "Negative-Hits: 1," in stats
+        print("SUCCESS: backend read-through works!")
+    finally:
+        proc.terminate()
+        proc.wait()
+
+
+if __name__ == "__main__":
+    server = sys.argv[1] if len(sys.argv) > 1 else os.path.join("build", "linux", "x86_64", "release", "kv_server")
+    test_backend(os.path.abspath(server))
@@ -0,0 +1,154 @@
+import os
+import re
+import signal
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+from test_protocol_v2 import FLAG_ORDERED, read_reply
+from test_protocol_v2 import encode_msg as encode_v2
+from test_replication import CMD_DEL, CMD_GET, CMD_INCR, CMD_SET, CMD_STATS, encode_msg, recv_exact, wait_for_port
+
+PORT = 8096
+BACKEND_PORT = 8097
+CLIENTS = 50
+PIPELINE = 40  # Per client, more keys than shards, so some share a shard lock
+
+
+def read_value(s):
+    magic, version, cmd, key_len, val_len = struct.unpack("!HBBII", recv_exact(s, 12))
+    return recv_exact(s, key_len + val_len)[key_len:].decode()
+
+
+def read_aof_keys(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    keys, pos = [], 0
+    while pos < len(data):
+        magic, version, cmd, key_len, val_len = struct.unpack_from("!HBBII", data, pos)
+        keys.append(data[pos + 12 : pos + 12 + key_len].decode())
+        pos += 12 + key_len + val_len
+    return keys
+
+
+def test_batching(server_bin):
+    workdir = tempfile.mkdtemp()
+    proc = subprocess.Popen([server_bin, str(PORT)], cwd=workdir, stdout=subprocess.DEVNULL)
+    try:
+        wait_for_port(PORT)
+        clients = [socket.create_connection(("127.0.0.1", PORT)) for _ in range(CLIENTS)]
+        try:
+            # Every client writes then reads its keys in one pipelined burst
+            for c, s in enumerate(clients):
+                burst = b"".join(encode_msg(CMD_SET, f"c{c}-k{i}", f"v{i}") for i in range(PIPELINE))
+                burst += b"".join(encode_msg(CMD_GET, f"c{c}-k{i}") for i in range(PIPELINE))
+                s.sendall(burst)
+            for c, s in enumerate(clients):
+                assert [read_value(s) for _ in range(PIPELINE)] == [""] * PIPELINE
+                assert [read_value(s) for _ in range(PIPELINE)] == [f"v{i}" for i in range(PIPELINE)], c
+            print("Pipelined writes are seen by the reads behind them: OK")
+
+            # Each client's SETs span several shards; the AOF has them in the order sent
+            time.sleep(0.5)
+            logged = {}
+            for key in read_aof_keys(os.path.join(workdir, "appendonly.aof")):
+                client, i = re.fullmatch(r"c(\d+)-k(\d+)", key).groups()
+                logged.setdefault(int(client), []).append(int(i))
+            assert all(logged[c] == list(range(PIPELINE)) for c in range(CLIENTS)), logged
+            print("Each connection's writes are logged in order: OK")
+
+            # Commands that are not grouped keep their place between grouped ones
+            s = clients[0]
+            s.sendall(
+                encode_msg(CMD_SET, "counter", "1")
+                + encode_msg(CMD_INCR, "counter")
+                + encode_msg(CMD_GET, "counter")
+                + encode_msg(CMD_DEL, "counter")
+                + encode_msg(CMD_GET, "counter")
+            )
+            assert [read_value(s) for _ in range(5)] == ["", "2", "2", "", ""]
+            print("Mixed commands stay in order: OK")
+
+            def batched_ops():
+                s.sendall(encode_msg(CMD_STATS, ""))
+                return int(re.search(r"Batched-Ops: (\d+)", read_value(s)).group(1))
+
+            # v2 requests without FLAG_ORDERED keep running out of order on the pool
+            s.sendall(b"".join(encode_msg(CMD_SET, f"v2-k{i}", f"v{i}") for i in range(10)))
+            assert [read_value(s) for _ in range(10)] == [""] * 10
+            before = batched_ops()
+            s.sendall(b"".join(encode_v2(CMD_GET, f"v2-k{i}", "", 2, i) for i in range(10)))
+            assert sorted(read_reply(s)[1:] for _ in range(10)) == sorted((i, f"v{i}") for i in range(10))
+            assert batched_ops() == before
+            s.sendall(b"".join(encode_v2(CMD_GET, f"v2-k{i}", "", 2, i, FLAG_ORDERED) for i in range(10)))
+            assert [read_reply(s)[1:] for _ in range(10)] == [(i, f"v{i}") for i in range(10)]
+            assert batched_ops() == before + 10
+            print("Only v1 and ordered v2 requests are batched: OK")
+
+            s.sendall(encode_msg(CMD_STATS, ""))
+            stats = read_value(s)
+        finally:
+            for s in clients:
+                s.close()
+        print(f"Stats: {stats}")
+
+        match = re.search(r"Shard-Batches: (\d+), Batched-Ops: (\d+)", stats)
+        assert match, stats
+        batches, ops = int(match.group(1)), int(match.group(2))
+        assert ops >= CLIENTS * PIPELINE * 2, stats
+        assert batches < ops, stats
+        print("SUCCESS: requests share shard lock acquisitions!")
+    finally:
+        proc.terminate()
+        proc.wait()
+
+
+def test_slow_backend(server_bin):
+    workdir = tempfile.mkdtemp()
+    backend_dir = os.path.join(workdir, "backend")
+    os.mkdir(backend_dir)
+    fifo = os.path.join(backend_dir, "slow")
+    os.mkfifo(fifo)  # Loading it blocks until a writer opens the FIFO
+
+    proc = subprocess.Popen([server_bin, str(BACKEND_PORT), "--backend-dir", backend_dir], cwd=workdir,
+                            stdout=subprocess.DEVNULL)
+    try:
+        wait_for_port(BACKEND_PORT)
+        slow = socket.create_connection(("127.0.0.1", BACKEND_PORT))
+        others = [socket.create_connection(("127.0.0.1", BACKEND_PORT)) for _ in range(5)]
+        try:
+            # Requests that arrive in the same round as the blocked load are still answered.
+            # The server is stopped while they are sent, so one epoll_wait returns them all.
+            proc.send_signal(signal.SIGSTOP)
+            slow.sendall(encode_msg(CMD_GET, "slow"))
+            for c, s in enumerate(others):
+                s.sendall(encode_msg(CMD_SET, f"other{c}", "v") + encode_msg(CMD_GET, f"other{c}"))
+            time.sleep(0.1)
+            proc.send_signal(signal.SIGCONT)
+            for s in others:
+                s.settimeout(1)
+                assert [read_value(s) for _ in range(2)] == ["", "v"]
+
+            with open(fifo, "w") as f:
+                f.write("loaded")
+            assert read_value(slow) == "loaded"
+            print("A slow backend load holds up only its own connection: OK")
+        finally:
+            for s in [slow] + others:
+                s.close()
+    finally:
+        try:
+            os.close(os.open(fifo, os.O_WRONLY | os.O_NONBLOCK))  # Releases a load still blocked
+        except OSError:
+            pass
+        proc.terminate()
+        proc.wait()
+
+
+if __name__ == "__main__":
+    server = sys.argv[1] if len(sys.argv) > 1 else os.path.join("build", "linux", "x86_64", "release", "kv_server")
+    test_batching(os.path.abspath(server))
+    test_slow_backend(os.path.abspath(server))
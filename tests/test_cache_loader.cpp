@@ -0,0 +1,215 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sharded_cache.h"
+
+using namespace kvcache;
+using namespace std::chrono_literals;
+
+using Cache = ShardedCache<std::string, std::string>;
+using Value = std::optional<std::string>;
+
+namespace {
+
+Cache makeCache(Cache::Loading::Options options = Cache::Loading::Options()) {
+    Cache cache(100, 4);
+    cache.enableLoading(options);
+    return cache;
+}
+
+}  // namespace
+
+TEST(CacheLoaderTest, ConcurrentMissesShareOneLoad) {
+    auto cache = makeCache();
+    std::atomic<int> calls{0};
+    auto loader = [&calls]() {
+        calls++;
+        std::this_thread::sleep_for(50ms);
+        return Value("v");
+    };
+
+    std::vector<std::thread> threads;
+    std::atomic<int> correct{0};
+    for (int i = 0; i < 8; ++i) {
+        threads.emplace_back([&]() {
+            if (cache.getOrLoad("k", loader) == Value("v")) correct++;
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    EXPECT_EQ(calls.load(), 1);
+    EXPECT_EQ(correct.load(), 8);
+    EXPECT_EQ(cache.get("k").value_or(""), "v");
+}
+
+TEST(CacheLoaderTest, NotFoundIsCachedBriefly) {
+    Cache::Loading::Options options;
+    options.negative_ttl = 50ms;
+    auto cache = makeCache(options);
+    int calls = 0;
+    auto loader = [&calls]() {
+        calls++;
+        return Value();
+    };
+
+    EXPECT_FALSE(cache.getOrLoad("k", loader).has_value());
+    EXPECT_FALSE(cache.getOrLoad("k", loader).has_value());
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(cache.loading()->stats().negative_hits.load(), 1u);
+
+    std::this_thread::sleep_for(60ms);
+    EXPECT_FALSE(cache.getOrLoad("k", loader).has_value());
+    EXPECT_EQ(calls, 2);
+
+    // A direct write is served despite the cached miss
+    cache.put("k", "direct");
+    EXPECT_EQ(cache.getOrLoad("k", loader), Value("direct"));
+}
+
+TEST(CacheLoaderTest, ExpiresAndRefreshesAhead) {
+    Cache::Loading::Options options;
+    options.ttl = 200ms;
+    options.refresh_ahead = 0.5;
+    auto cache = makeCache(options);
+    std::atomic<int> calls{0};
+    auto loader = [&calls]() { return Value("v" + std::to_string(++calls)); };
+
+    EXPECT_EQ(cache.getOrLoad("k", loader), Value("v1"));
+    EXPECT_EQ(cache.getOrLoad("k", loader), Value("v1"));
+
+    // Past refresh_ahead the hit still answers at once and reloads in the background
+    std::this_thread::sleep_for(120ms);
+    EXPECT_EQ(cache.getOrLoad("k", loader), Value("v1"));
+    for (int i = 0; i < 100 && cache.get("k") != Value("v2"); ++i) {
+        std::this_thread::sleep_for(1ms);
+    }
+    EXPECT_EQ(cache.get("k"), Value("v2"));
+    EXPECT_EQ(cache.loading()->stats().refreshes.load(), 1u);
+
+    // Past ttl the entry is reloaded before answering
+    std::this_thread::sleep_for(210ms);
+    EXPECT_EQ(cache.getOrLoad("k", loader), Value("v3"));
+    EXPECT_EQ(cache.loading()->stats().expired.load(), 1u);
+
+    // Written directly: no longer expires
+    cache.put("k", "direct");
+    std::this_thread::sleep_for(210ms);
+    EXPECT_EQ(cache.getOrLoad("k", loader), Value("direct"));
+}
+
+TEST(CacheLoaderTest, ExpiresWithMoreKeysThanRecords) {
+    Cache cache(1000, 4);
+    Cache::Loading::Options options;
+    options.ttl = 50ms;
+    options.max_records = 64;
+    cache.enableLoading(options);
+
+    for (int i = 0; i < 500; ++i) {
+        EXPECT_EQ(cache.getOrLoad("k" + std::to_string(i), []() { return Value("old"); }), Value("old"));
+    }
+
+    // Keys whose records were dropped are loaded again, not served stale
+    std::this_thread::sleep_for(60ms);
+    for (int i = 0; i < 500; ++i) {
+        EXPECT_EQ(cache.getOrLoad("k" + std::to_string(i), []() { return Value("new"); }), Value("new")) << i;
+    }
+}
+
+TEST(CacheLoaderTest, WriteDuringLoadWins) {
+    auto cache = makeCache();
+    std::promise<void> started, release;
+    auto released = release.get_future().share();
+    auto loader = [&]() {
+        started.set_value();
+        released.wait();
+        return Value("loaded");
+    };
+
+    auto result = std::async(std::launch::async, [&]() { return cache.getOrLoad("k", loader); });
+    started.get_future().wait();
+    cache.put("k", "written");
+    release.set_value();
+
+    EXPECT_EQ(result.get(), Value("written"));
+    EXPECT_EQ(cache.get("k"), Value("written"));
+}
+
+TEST(CacheLoaderTest, WriteDuringReloadSurvivesNotFound) {
+    Cache::Loading::Options options;
+    options.ttl = 20ms;
+    auto cache = makeCache(options);
+    EXPECT_EQ(cache.getOrLoad("k", []() { return Value("loaded"); }), Value("loaded"));
+    std::this_thread::sleep_for(30ms);
+
+    // The expired key is reloaded, and the source no longer has it
+    std::promise<void> started, release;
+    auto released = release.get_future().share();
+    auto loader = [&]() {
+        started.set_value();
+        released.wait();
+        return Value();
+    };
+    auto result = std::async(std::launch::async, [&]() { return cache.getOrLoad("k", loader); });
+    started.get_future().wait();
+    cache.put("k", "direct");
+    release.set_value();
+
+    result.get();
+    EXPECT_EQ(cache.get("k"), Value("direct"));
+}
+
+TEST(CacheLoaderTest, BatchLoadsOnlyMisses) {
+    auto cache = makeCache();
+    cache.put("a", "1");
+    std::vector<std::string> requested;
+    auto loader = [&requested](const std::vector<std::string>& keys) {
+        requested = keys;
+        std::vector<Value> values;
+        for (const auto& key : keys) {
+            values.push_back(key == "c" ? Value() : Value(key + "!"));
+        }
+        return values;
+    };
+
+    auto values = cache.getAllOrLoad({"a", "b", "c"}, loader);
+    EXPECT_EQ(requested, (std::vector<std::string>{"b", "c"}));
+    ASSERT_EQ(values.size(), 3u);
+    EXPECT_EQ(values[0], Value("1"));
+    EXPECT_EQ(values[1], Value("b!"));
+    EXPECT_FALSE(values[2].has_value());
+    EXPECT_EQ(cache.get("b"), Value("b!"));
+}
+
+TEST(CacheLoaderTest, AsyncLoader) {
+    auto cache = makeCache();
+    auto loader = []() { return std::async(std::launch::async, []() { return Value("v"); }); };
+
+    EXPECT_EQ(cache.getOrLoad("sync", loader), Value("v"));
+    auto future = cache.getOrLoadAsync("async", loader);
+    EXPECT_EQ(future.get(), Value("v"));
+    EXPECT_EQ(cache.get("async"), Value("v"));
+}
+
+TEST(CacheLoaderTest, LoaderErrorsAreNotCached) {
+    auto cache = makeCache();
+    auto failing = []() -> Value { throw std::runtime_error("backend down"); };
+    EXPECT_THROW(cache.getOrLoad("k", failing), std::runtime_error);
+    EXPECT_EQ(cache.getOrLoad("k", []() { return Value("v"); }), Value("v"));
+}
+
+TEST(CacheLoaderTest, RequiresEnableLoading) {
+    Cache cache(10, 1);
+    EXPECT_THROW(cache.getOrLoad("k", []() { return Value("v"); }), std::logic_error);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
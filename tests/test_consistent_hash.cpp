@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "consistent_hash.h"
+
+using namespace kvcache;
+
+TEST(HashRingTest, EvenDistribution) {
+    HashRing ring;
+    for (int i = 0; i < 4; ++i) {
+        ring.addNode("node" + std::to_string(i));
+    }
+
+    std::map<std::string, int> counts;
+    const int num_keys = 40000;
+    for (int i = 0; i < num_keys; ++i) {
+        counts[ring.locate("key" + std::to_string(i))]++;
+    }
+
+    ASSERT_EQ(counts.size(), 4);
+    for (const auto& [node, count] : counts) {
+        EXPECT_NEAR(count, num_keys / 4, num_keys / 4 * 0.2) << node;
+    }
+}
+
+TEST(HashRingTest, AddNodeMovesAboutOneNth) {
+    HashRing ring;
+    for (int i = 0; i < 4; ++i) {
+        ring.addNode("node" + std::to_string(i));
+    }
+
+    const int num_keys = 40000;
+    std::vector<std::string> before;
+    for (int i = 0; i < num_keys; ++i) {
+        before.push_back(ring.locate("key" + std::to_string(i)));
+    }
+
+    ring.addNode("node4");
+
+    int moved = 0;
+    for (int i = 0; i < num_keys; ++i) {
+        const auto& now = ring.locate("key" + std::to_string(i));
+        if (now != before[i]) {
+            // Keys only ever move to the new node
+            EXPECT_EQ(now, "node4");
+            moved++;
+        }
+    }
+    EXPECT_NEAR(moved, num_keys / 5, num_keys / 5 * 0.25);
+}
+
+TEST(HashRingTest, RemoveNodeOnlyMovesItsKeys) {
+    HashRing ring;
+    for (int i = 0; i < 5; ++i) {
+        ring.addNode("node" + std::to_string(i));
+    }
+
+    const int num_keys = 20000;
+    std::vector<std::string> before;
+    for (int i = 0; i < num_keys; ++i) {
+        before.push_back(ring.locate("key" + std::to_string(i)));
+    }
+
+    ring.removeNode("node2");
+    EXPECT_EQ(ring.nodes().size(), 4);
+
+    for (int i = 0; i < num_keys; ++i) {
+        const auto& now = ring.locate("key" + std::to_string(i));
+        EXPECT_NE(now, "node2");
+        if (before[i] != "node2") {
+            EXPECT_EQ(now, before[i]);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,164 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hot_keys.h"
+#include "sharded_cache.h"
+
+using namespace kvcache;
+
+namespace {
+
+HotKeyTracker<std::string, std::string>::Options eagerOptions() {
+    HotKeyTracker<std::string, std::string>::Options options;
+    options.sample_every = 1;
+    options.window = 100;
+    options.hot_share = 0.2;
+    options.merge_every = 1;
+    return options;
+}
+
+}  // namespace
+
+TEST(HotKeyTest, DetectsHeavyHitters) {
+    HotKeyTracker<std::string, std::string> tracker(eagerOptions());
+    auto load = []() { return std::optional<std::string>("v"); };
+    for (int i = 0; i < 100; ++i) {
+        tracker.get(i % 2 ? "hot" : "cold" + std::to_string(i), load);
+    }
+
+    auto hot = tracker.hotKeys();
+    ASSERT_EQ(hot.size(), 1u);
+    EXPECT_EQ(hot[0], "hot");
+
+    auto top = tracker.topKeys();
+    ASSERT_FALSE(top.empty());
+    EXPECT_EQ(top[0].first, "hot");
+    EXPECT_EQ(top[0].second, 50u);
+}
+
+TEST(HotKeyTest, SamplesAreMergedInBatches) {
+    auto options = eagerOptions();
+    options.window = 20;
+    options.merge_every = 10;
+    HotKeyTracker<std::string, std::string> tracker(options);
+    auto load = []() { return std::optional<std::string>("v"); };
+    for (int i = 0; i < 19; ++i) {
+        tracker.get("hot", load);
+    }
+    EXPECT_TRUE(tracker.hotKeys().empty());  // 9 samples still held by this thread
+
+    tracker.get("hot", load);
+    auto top = tracker.topKeys();
+    ASSERT_EQ(top.size(), 1u);
+    EXPECT_EQ(top[0].second, 20u);
+    EXPECT_EQ(tracker.hotKeys(), std::vector<std::string>{"hot"});
+}
+
+TEST(HotKeyTest, DestroyedTrackersLeaveNoThreadState) {
+    using Tracker = HotKeyTracker<std::string, std::shared_ptr<int>>;
+    Tracker::Options options;
+    options.sample_every = 1;
+    options.window = 100;
+    options.merge_every = 1;
+    auto value = std::make_shared<int>(1);
+    auto load = [&value]() { return std::optional<std::shared_ptr<int>>(value); };
+
+    for (int i = 0; i < 100; ++i) {
+        Tracker tracker(options);
+        for (int j = 0; j < 150; ++j) {
+            tracker.get("hot", load);
+        }
+        EXPECT_GT(value.use_count(), 1);  // This thread holds a copy
+    }
+
+    // The copies of the destroyed trackers go once this thread uses another one
+    Tracker tracker(options);
+    tracker.get("cold", load);
+    EXPECT_EQ(value.use_count(), 1);
+}
+
+TEST(HotKeyTest, CopiesAreServedAndInvalidated) {
+    ShardedCache<std::string, std::string> cache(100, 4);
+    cache.enableHotKeys(eagerOptions());
+    cache.put("hot", "v1");
+    for (int i = 0; i < 100; ++i) {
+        cache.get("hot");
+    }
+
+    // Now hot: the first read fills the copy, later reads skip the shard
+    cache.get("hot");
+    size_t shard_hits = cache.getStats().hits;
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(cache.get("hot").value_or(""), "v1");
+    }
+    EXPECT_EQ(cache.getStats().hits, shard_hits);
+    EXPECT_EQ(cache.hotKeys()->copyHits(), 10u);
+
+    cache.put("hot", "v2");
+    EXPECT_EQ(cache.get("hot").value_or(""), "v2");
+    cache.update("hot", [](const std::string*, uint64_t) { return std::optional<std::string>("v3"); });
+    EXPECT_EQ(cache.get("hot").value_or(""), "v3");
+    cache.remove("hot");
+    EXPECT_FALSE(cache.get("hot").has_value());
+}
+
+TEST(HotKeyTest, HotKeyStaysRecentInItsShard) {
+    auto options = eagerOptions();
+    options.refresh_every = 4;
+    ShardedCache<std::string, std::string> cache(4, 1);
+    cache.enableHotKeys(options);
+    cache.put("hot", "v");
+    for (int i = 0; i < 100; ++i) {
+        cache.get("hot");
+    }
+    ASSERT_EQ(cache.hotKeys()->hotKeys(), std::vector<std::string>{"hot"});
+
+    // Mostly served from the copy, yet often enough read from the shard to outlive the churn
+    for (int i = 0; i < 50; ++i) {
+        cache.put("cold" + std::to_string(i), "v");
+        for (int j = 0; j < 4; ++j) {
+            EXPECT_EQ(cache.get("hot").value_or(""), "v");
+        }
+    }
+    EXPECT_TRUE(cache.exists("hot"));
+    EXPECT_GT(cache.hotKeys()->copyHits(), 100u);
+}
+
+TEST(HotKeyTest, ReadersNeverSeeOlderValueAfterWrite) {
+    ShardedCache<std::string, std::string> cache(100, 4);
+    cache.enableHotKeys(eagerOptions());
+    cache.put("counter", "0");
+
+    std::atomic<int> written{0};
+    std::atomic<bool> stale{false};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&]() {
+            while (written < 2000) {
+                int floor = written;  // Acknowledged before this read started
+                auto value = cache.get("counter");
+                if (!value || std::stoi(*value) < floor) stale = true;
+            }
+        });
+    }
+    for (int i = 1; i <= 2000; ++i) {
+        cache.put("counter", std::to_string(i));
+        written = i;
+    }
+    for (auto& t : readers) {
+        t.join();
+    }
+
+    EXPECT_FALSE(stale);
+    EXPECT_EQ(cache.get("counter").value_or(""), "2000");
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <shared_mutex>
 #include <string>
+#include <vector>
 
 #include "lru_cache.h"
 
@@ -34,6 +37,20 @@ TEST(LRUCacheTest, EvictionPolicy) {
     EXPECT_FALSE(cache.get(2).has_value());
 }
 
+TEST(LRUCacheTest, FifoEvictionIgnoresHits) {
+    LRUCache<int, int, FifoEviction> cache(2);
+    cache.put(1, 10);
+    cache.put(2, 20);
+
+    // Unlike LRU, reading 1 does not protect it
+    cache.get(1);
+    cache.put(3, 30);
+
+    EXPECT_FALSE(cache.get(1).has_value());
+    EXPECT_TRUE(cache.get(2).has_value());
+    EXPECT_TRUE(cache.get(3).has_value());
+}
+
 TEST(LRUCacheTest, UpdateValue) {
     LRUCache<int, int> cache(2);
     cache.put(1, 10);
@@ -42,6 +59,105 @@ TEST(LRUCacheTest, UpdateValue) {
     EXPECT_EQ(cache.get(1).value(), 20);
     EXPECT_EQ(cache.size(), 1);
 }
+TEST(LRUCacheTest, RemoveAndForEach) {
+    LRUCache<int, int> cache(3);
+    cache.put(1, 10);
+    cache.put(2, 20);
+    cache.put(3, 30);
+
+    EXPECT_TRUE(cache.remove(2));
+    EXPECT_FALSE(cache.remove(2));
+    EXPECT_EQ(cache.size(), 2);
+
+    std::vector<std::pair<int, int>> items;
+    cache.forEach([&items](int k, int v) { items.emplace_back(k, v); });
+    ASSERT_EQ(items.size(), 2);
+    EXPECT_EQ(items[0], std::make_pair(3, 30));  // Most recent first
+    EXPECT_EQ(items[1], std::make_pair(1, 10));
+
+    cache.clear();
+    EXPECT_EQ(cache.size(), 0);
+}
+
+TEST(LRUCacheTest, VersionsAndUpdate) {
+    LRUCache<std::string, int> cache(2);
+    cache.put("a", 1);
+    auto v1 = cache.getVersioned("a");
+    ASSERT_TRUE(v1.has_value());
+
+    // Read-modify-write bumps the version
+    uint64_t v2 = cache.update("a", [](const int* current, uint64_t) { return std::optional<int>(*current + 1); });
+    EXPECT_GT(v2, v1->second);
+    EXPECT_EQ(cache.get("a").value(), 2);
+
+    // Declining leaves value and version alone
+    EXPECT_EQ(cache.update("a", [](const int*, uint64_t) { return std::optional<int>(); }), 0);
+    EXPECT_EQ(cache.getVersioned("a")->second, v2);
+
+    // Missing keys are seen as nullptr and get inserted
+    uint64_t v3 = cache.update("b", [](const int* current, uint64_t version) {
+        EXPECT_EQ(current, nullptr);
+        EXPECT_EQ(version, 0);
+        return std::optional<int>(7);
+    });
+    EXPECT_GT(v3, v2);
+    EXPECT_EQ(cache.get("b").value(), 7);
+}
+
+TEST(LRUCacheTest, EvictionListener) {
+    LRUCache<int, int> cache(2);
+    std::vector<std::pair<int, int>> evicted;
+    cache.setEvictionListener([&](const int& key, const int& value) { evicted.emplace_back(key, value); });
+
+    cache.put(1, 10);
+    cache.put(2, 20);
+    cache.remove(2);  // Removals are not evictions
+    cache.put(3, 30);
+    cache.put(4, 40);
+
+    ASSERT_EQ(evicted.size(), 1u);
+    EXPECT_EQ(evicted[0], std::make_pair(1, 10));
+}
+
+namespace {
+
+// A shared_mutex that counts how it was taken
+struct CountingLock {
+    std::shared_mutex mutex;
+    int exclusive = 0;
+    std::atomic<int> shared{0};
+    void lock() {
+        mutex.lock();
+        exclusive++;
+    }
+    void unlock() { mutex.unlock(); }
+    void lock_shared() {
+        mutex.lock_shared();
+        shared++;
+    }
+    void unlock_shared() { mutex.unlock_shared(); }
+};
+
+}  // namespace
+
+TEST(LRUCacheTest, FifoReadsShareTheLock) {
+    LRUCache<int, int, FifoEviction, CountingLock> fifo(4);
+    fifo.put(1, 10);
+    int writes = fifo.acquire().mutex()->exclusive;
+    EXPECT_EQ(fifo.get(1), std::optional<int>(10));
+    EXPECT_FALSE(fifo.get(2).has_value());
+    EXPECT_EQ(fifo.acquire().mutex()->exclusive, writes + 1);  // Only the acquire() itself
+    EXPECT_EQ(fifo.getStats().hits, 1u);
+    EXPECT_EQ(fifo.getStats().misses, 1u);
+
+    // LRU hits relink the list, so they stay exclusive
+    LRUCache<int, int, LruEviction, CountingLock> lru(4);
+    lru.put(1, 10);
+    int shared = lru.acquire().mutex()->shared.load();
+    lru.get(1);
+    EXPECT_EQ(lru.acquire().mutex()->shared.load(), shared);
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
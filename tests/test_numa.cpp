@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "numa.h"
+#include "tcp_server.h"
+
+using namespace kvcache;
+
+TEST(NumaTest, RangeLists) {
+    EXPECT_EQ(parseRangeList("0-3,8,10-11"), (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_EQ(parseRangeList(""), std::vector<int>{});
+    EXPECT_THROW(parseRangeList("1-"), std::invalid_argument);
+    EXPECT_THROW(parseRangeList("3-1"), std::invalid_argument);
+    EXPECT_THROW(parseRangeList("1,,2"), std::invalid_argument);
+    EXPECT_THROW(parseRangeList("2x"), std::invalid_argument);
+
+    EXPECT_EQ(formatRangeList({11, 0, 1, 2, 3, 8, 10}), "0-3,8,10-11");
+    EXPECT_EQ(formatRangeList({}), "");
+}
+
+TEST(NumaTest, RestrictDropsEmptyNodes) {
+    NumaTopology topology({{0, {0, 1, 2, 3}}, {1, {4, 5, 6, 7}}});
+    EXPECT_EQ(topology.nodeOf(5), 1);
+    EXPECT_EQ(topology.nodeOf(9), -1);
+
+    auto restricted = topology.restrictTo({1, 2});
+    ASSERT_EQ(restricted.nodes().size(), 1u);
+    EXPECT_EQ(restricted.nodes()[0].id, 0);
+    EXPECT_EQ(restricted.nodes()[0].cpus, (std::vector<int>{1, 2}));
+}
+
+TEST(NumaTest, DetectsThisMachine) {
+    NumaTopology topology = NumaTopology::detect();
+    ASSERT_FALSE(topology.nodes().empty());
+
+    std::vector<int> allowed = NumaTopology::allowedCpus();
+    ASSERT_FALSE(allowed.empty());
+    EXPECT_GE(topology.nodeOf(allowed[0]), 0);
+    EXPECT_TRUE(pinThread(allowed[0]));
+}
+
+TEST(NumaTest, BindsMemoryToNode) {
+    int node = NumaTopology::detect().restrictTo(NumaTopology::allowedCpus()).nodes()[0].id;
+    size_t len = 4 * sysconf(_SC_PAGESIZE);
+    void* mem = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(mem, MAP_FAILED);
+    static_cast<char*>(mem)[0] = 1;
+
+    EXPECT_TRUE(bindMemory(mem, len, node));
+    EXPECT_FALSE(bindMemory(mem, len, -1));
+    munmap(mem, len);
+}
+
+namespace {
+
+std::vector<TcpServer::Lane> twoLanes() {
+    return {TcpServer::Lane{-1, {}, 1}, TcpServer::Lane{-1, {}, 1}};
+}
+
+}  // namespace
+
+TEST(NumaTest, RunOnLanesHandsTasksToTheirLane) {
+    TcpServer server(0, twoLanes());
+    std::atomic<int> runs{0}, handed_off{0};
+    for (int round = 0; round < 20; ++round) {
+        std::vector<TcpServer::LaneTask> tasks;
+        for (size_t lane = 0; lane < 2; ++lane) {
+            tasks.emplace_back(lane, [&, caller = std::this_thread::get_id()]() {
+                runs++;
+                if (std::this_thread::get_id() != caller) handed_off++;
+            });
+        }
+        server.runOnLanes(std::move(tasks));
+    }
+    EXPECT_EQ(runs, 40);
+    EXPECT_GT(handed_off, 0);
+}
+
+TEST(NumaTest, LanesWaitingOnEachOtherDoNotDeadlock) {
+    TcpServer server(0, twoLanes());
+    std::atomic<int> runs{0};
+    auto wait_on = [&](size_t other) {
+        return [&, other]() {
+            server.runOnLanes({{other, [&]() { runs++; }}});
+            runs++;
+        };
+    };
+    server.runOnLanes({{0, wait_on(1)}, {1, wait_on(0)}});
+    EXPECT_EQ(runs, 4);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
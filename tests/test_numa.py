@@ -0,0 +1,78 @@
+import os
+import re
+import socket
+import subprocess
+import sys
+import tempfile
+
+from test_replication import CMD_GET, CMD_SET, CMD_STATS, encode_msg, recv_exact, send_cmd, wait_for_port
+
+PORT = 8095
+SEGMENT = f"/kvcache_numa_{os.getpid()}"
+
+
+def test_numa(server_bin):
+    cpu = sorted(os.sched_getaffinity(0))[0]
+    workdir = tempfile.mkdtemp()
+    proc = subprocess.Popen(
+        [server_bin, str(PORT), "--numa", "--cpus", str(cpu), "--shm", SEGMENT],
+        cwd=workdir,
+        stdout=subprocess.DEVNULL,
+    )
+    try:
+        wait_for_port(PORT)
+        for i in range(100):
+            send_cmd(PORT, CMD_SET, f"key{i}", f"v{i}")
+        for i in range(100):
+            assert send_cmd(PORT, CMD_GET, f"key{i}") == f"v{i}"
+        print("Pinned server serves requests: OK")
+
+        # Open connections are counted on their lane
+        held = [socket.create_connection(("127.0.0.1", PORT)) for _ in range(3)]
+        try:
+            s = held[0]
+            s.sendall(encode_msg(CMD_STATS, ""))
+            header = recv_exact(s, 12)
+            key_len, val_len = int.from_bytes(header[4:8], "big"), int.from_bytes(header[8:12], "big")
+            stats = recv_exact(s, key_len + val_len)[key_len:].decode()
+        finally:
+            for s in held:
+                s.close()
+        print(f"Stats: {stats}")
+
+        match = re.search(r"Numa-Cpus: node(\d+)=(\d+),", stats)
+        assert match and int(match.group(2)) == cpu, stats
+        node = match.group(1)
+        assert f"Numa-Conns: node{node}=3," in stats, stats
+        assert f"Numa-Shards: node{node}=0-15" in stats, stats
+        assert "Pinned-Threads: 0" not in stats, stats
+    finally:
+        proc.terminate()
+        proc.wait()
+        shm_path = "/dev/shm" + SEGMENT
+        if os.path.exists(shm_path):
+            os.remove(shm_path)
+
+    # Heap shards: batched requests run on the lane of their shard's node
+    proc = subprocess.Popen(
+        [server_bin, str(PORT), "--numa", "--cpus", str(cpu)], cwd=tempfile.mkdtemp(), stdout=subprocess.DEVNULL
+    )
+    try:
+        wait_for_port(PORT)
+        for i in range(100):
+            send_cmd(PORT, CMD_SET, f"key{i}", f"v{i}")
+        for i in range(100):
+            assert send_cmd(PORT, CMD_GET, f"key{i}") == f"v{i}"
+        stats = send_cmd(PORT, CMD_STATS, "")
+        assert f"Numa-Routed-Shards: node{node}=0-15" in stats, stats
+        assert "Numa-Shards" not in stats, stats
+        print("Heap shards routed to their node: OK")
+        print("SUCCESS: NUMA placement works!")
+    finally:
+        proc.terminate()
+        proc.wait()
+
+
+if __name__ == "__main__":
+    server = sys.argv[1] if len(sys.argv) > 1 else os.path.join("build", "linux", "x86_64", "release", "kv_server")
+    test_numa(os.path.abspath(server))
@@ -0,0 +1,97 @@
+import socket
+import struct
+import sys
+import time
+
+MAGIC = 0xCAFE
+CMD_SET = 1
+CMD_GET = 2
+CMD_STATS = 4
+CMD_PING = 6
+FLAG_ORDERED = 0x1
+
+
+def encode_msg(cmd, key, value="", version=1, request_id=0, flags=0):
+    key_bytes = key.encode()
+    value_bytes = value.encode()
+    header = struct.pack("!HBBII", MAGIC, version, cmd, len(key_bytes), len(value_bytes))
+    if version >= 2:
+        header += struct.pack("!IHH", request_id, flags, 0)
+    return header + key_bytes + value_bytes
+
+
+def recv_exact(s, n):
+    data = b""
+    while len(data) < n:
+        chunk = s.recv(n - len(data))
+        if not chunk:
+            break
+        data += chunk
+    return data
+
+
+def read_reply(s):
+    magic, version, cmd, key_len, val_len = struct.unpack("!HBBII", recv_exact(s, 12))
+    request_id = None
+    if version >= 2:
+        request_id, flags, _ = struct.unpack("!IHH", recv_exact(s, 8))
+    body = recv_exact(s, key_len + val_len)
+    return version, request_id, body[key_len:].decode()
+
+
+def test_protocol_v2(port):
+    s = socket.create_connection(("localhost", port))
+
+    print("Negotiation...")
+    s.sendall(encode_msg(CMD_PING, ""))
+    assert read_reply(s) == (1, None, "2")
+
+    print("v1 pipeline stays in order...")
+    s.sendall(b"".join(encode_msg(CMD_SET, f"v1_{i}", str(i)) for i in range(20)))
+    for _ in range(20):
+        read_reply(s)
+    s.sendall(b"".join(encode_msg(CMD_GET, f"v1_{i}") for i in range(20)))
+    for i in range(20):
+        assert read_reply(s) == (1, None, str(i))
+
+    print("v2 requests are matched by ID...")
+    batch = [encode_msg(CMD_SET, "big", "x" * (1 << 20), 2, 1)]
+    batch += [encode_msg(CMD_GET, f"v1_{i}", "", 2, 100 + i) for i in range(20)]
+    batch.append(encode_msg(CMD_GET, "big", "", 2, 500, FLAG_ORDERED))
+    batch.append(encode_msg(CMD_STATS, "", "", 2, 501))
+    s.sendall(b"".join(batch))
+
+    order = []
+    replies = {}
+    for _ in range(len(batch)):
+        version, request_id, value = read_reply(s)
+        assert version == 2
+        order.append(request_id)
+        replies[request_id] = value
+    assert sorted(order) == sorted([1, 500, 501] + [100 + i for i in range(20)])
+    for i in range(20):
+        assert replies[100 + i] == str(i)
+
+    # The ordered GET sees the SET before it and is answered after every earlier request
+    assert replies[500] == "x" * (1 << 20)
+    assert order.index(500) == len(batch) - 2 and order[-1] == 501
+    print(f"Reply order: {order[:5]} ... {order[-3:]}")
+
+    print("Replies to a slow reader arrive whole...")
+    s.settimeout(10)  # A truncated frame would leave the reader waiting for bytes
+    s.sendall(b"".join(encode_msg(CMD_GET, "big") for _ in range(16)))
+    time.sleep(2)  # Far more than the socket buffers hold is waiting to be sent
+    for _ in range(16):
+        assert read_reply(s) == (1, None, "x" * (1 << 20))
+
+    print("Unknown versions are rejected...")
+    s.sendall(encode_msg(CMD_GET, "v1_0", "", version=9))
+    assert read_reply(s)[2] == "ERR unsupported protocol version"
+
+    s.close()
+    print("SUCCESS: Protocol v2 works!")
+
+
+if __name__ == "__main__":
+    port = int(sys.argv[1]) if len(sys.argv) > 1 else 8080
+    test_protocol_v2(port)
@@ -0,0 +1,172 @@
+import os
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+MAGIC = 0xCAFE
+VERSION = 1
+CMD_SET = 1
+CMD_GET = 2
+CMD_DEL = 3
+CMD_STATS = 4
+CMD_MGET = 7
+
+BACKEND_PORTS = [8101, 8102, 8103]
+PROXY_PORT = 8100
+SILENT_PORT = 8105  # Accepts connections but never answers
+SILENT_PROXY_PORT = 8104
+
+
+def encode_msg(cmd, key, value=b""):
+    key_bytes = key.encode()
+    value_bytes = value if isinstance(value, bytes) else value.encode()
+    header = struct.pack("!HBBII", MAGIC, VERSION, cmd, len(key_bytes), len(value_bytes))
+    return header + key_bytes + value_bytes
+
+
+def recv_exact(s, n):
+    data = b""
+    while len(data) < n:
+        chunk = s.recv(n - len(data))
+        if not chunk:
+            raise ConnectionError("connection closed")
+        data += chunk
+    return data
+
+
+def recv_msg(s):
+    magic, version, cmd, key_len, val_len = struct.unpack("!HBBII", recv_exact(s, 12))
+    body = recv_exact(s, key_len + val_len)
+    return cmd, body[:key_len].decode(), body[key_len:]
+
+
+def send_cmd(port, cmd, key, value=b""):
+    s = socket.create_connection(("localhost", port))
+    s.sendall(encode_msg(cmd, key, value))
+    _, _, value = recv_msg(s)
+    s.close()
+    return value
+
+
+def pack_keys(keys):
+    return b"".join(struct.pack("!I", len(k)) + k.encode() for k in keys)
+
+
+def unpack_values(data):
+    values, pos = [], 0
+    while pos < len(data):
+        found = data[pos]
+        (length,) = struct.unpack("!I", data[pos + 1 : pos + 5])
+        pos += 5
+        values.append(data[pos : pos + length].decode() if found else None)
+        pos += length
+    return values
+
+
+def wait_for_port(port, timeout=5.0):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        try:
+            socket.create_connection(("localhost", port), timeout=0.2).close()
+            return
+        except OSError:
+            time.sleep(0.05)
+    raise RuntimeError(f"port {port} did not open")
+
+
+def test_proxy(bin_dir):
+    procs = []
+    try:
+        for port in BACKEND_PORTS:
+            procs.append(
+                subprocess.Popen(
+                    [os.path.join(bin_dir, "kv_server"), str(port)],
+                    cwd=tempfile.mkdtemp(),
+                    stdout=subprocess.DEVNULL,
+                )
+            )
+        for port in BACKEND_PORTS:
+            wait_for_port(port)
+
+        backends = [f"127.0.0.1:{p}" for p in BACKEND_PORTS]
+        procs.append(
+            subprocess.Popen([os.path.join(bin_dir, "kv_proxy"), str(PROXY_PORT)] + backends, stdout=subprocess.DEVNULL)
+        )
+        wait_for_port(PROXY_PORT)
+
+        # Pipeline 300 SETs on one connection, then read all replies
+        keys = [f"key{i}" for i in range(300)]
+        s = socket.create_connection(("localhost", PROXY_PORT))
+        s.sendall(b"".join(encode_msg(CMD_SET, k, f"val-{k}") for k in keys))
+        for _ in keys:
+            recv_msg(s)
+        s.sendall(b"".join(encode_msg(CMD_GET, k) for k in keys))
+        for k in keys:
+            _, key, value = recv_msg(s)
+            assert key == k and value.decode() == f"val-{k}", (k, key, value)
+        s.close()
+        print("Pipelined SET/GET: OK")
+
+        # Every key lives on exactly one backend and every backend got a share
+        per_backend = [sum(1 for k in keys if send_cmd(p, CMD_GET, k)) for p in BACKEND_PORTS]
+        print(f"Keys per backend: {per_backend}")
+        assert sum(per_backend) == len(keys) and min(per_backend) > 0
+
+        # MGET is split per backend and merged back in request order
+        mget_keys = keys[:50] + ["missing"]
+        values = unpack_values(send_cmd(PROXY_PORT, CMD_MGET, "", pack_keys(mget_keys)))
+        assert values == [f"val-{k}" for k in keys[:50]] + [None], values
+        print("MGET split/merge: OK")
+
+        # Clients waiting on a backend that never answers hold up no worker thread, so the
+        # other backend keeps serving far more clients than the proxy has threads
+        silent = socket.create_server(("127.0.0.1", SILENT_PORT), backlog=64)
+        procs.append(
+            subprocess.Popen(
+                [os.path.join(bin_dir, "kv_proxy"), str(SILENT_PROXY_PORT), backends[1], f"127.0.0.1:{SILENT_PORT}"],
+                stdout=subprocess.DEVNULL,
+            )
+        )
+        wait_for_port(SILENT_PROXY_PORT)
+        waiting, answered = [], 0
+        for k in keys[:40]:
+            c = socket.create_connection(("localhost", SILENT_PROXY_PORT))
+            c.settimeout(0.3)
+            c.sendall(encode_msg(CMD_GET, k))
+            try:
+                recv_msg(c)
+                answered += len(waiting) > 4
+                c.close()
+            except socket.timeout:
+                waiting.append(c)
+        for c in waiting:
+            c.close()
+        silent.close()
+        print(f"Stuck on the silent backend: {len(waiting)}, answered after the first 5: {answered}")
+        assert len(waiting) > 4 and answered > 0
+        print("Silent backend blocks no worker: OK")
+
+        stats = send_cmd(PROXY_PORT, CMD_STATS, "").decode()
+        print(f"Stats: {stats}")
+        assert stats.startswith("Backends: 3")
+
+        # With a backend down, an MGET touching it fails instead of reporting its keys missing
+        procs[0].terminate()
+        procs[0].wait()
+        value = send_cmd(PROXY_PORT, CMD_MGET, "", pack_keys(mget_keys))
+        assert value.startswith(b"ERR"), value
+        print("MGET with a backend down: OK")
+
+        print("SUCCESS: Proxy works!")
+    finally:
+        for p in procs:
+            p.terminate()
+            p.wait()
+
+
+if __name__ == "__main__":
+    bin_dir = sys.argv[1] if len(sys.argv) > 1 else os.path.join("build", "linux", "x86_64", "release")
+    test_proxy(os.path.abspath(bin_dir))
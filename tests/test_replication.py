@@ -0,0 +1,172 @@
+import os
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+MAGIC = 0xCAFE
+VERSION = 1
+CMD_SET = 1
+CMD_GET = 2
+CMD_DEL = 3
+CMD_STATS = 4
+CMD_SYNC = 5
+CMD_PING = 6
+CMD_INCR = 8
+CMD_APPEND = 10
+
+PRIMARY_PORT = 8090
+REPL_PORT = 9090
+REPLICA_PORT = 8091
+
+
+def encode_msg(cmd, key, value=""):
+    key_bytes = key.encode()
+    value_bytes = value.encode()
+    header = struct.pack("!HBBII", MAGIC, VERSION, cmd, len(key_bytes), len(value_bytes))
+    return header + key_bytes + value_bytes
+
+
+def recv_exact(s, n):
+    data = b""
+    while len(data) < n:
+        chunk = s.recv(n - len(data))
+        if not chunk:
+            break
+        data += chunk
+    return data
+
+
+def send_cmd(port, cmd, key, value=""):
+    s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    s.connect(("localhost", port))
+    s.sendall(encode_msg(cmd, key, value))
+
+    magic, version, resp_cmd, key_len, val_len = struct.unpack("!HBBII", recv_exact(s, 12))
+    body = recv_exact(s, key_len + val_len)
+    s.close()
+    return body[key_len:].decode()
+
+
+def read_frame(s):
+    magic, version, cmd, key_len, val_len = struct.unpack("!HBBII", recv_exact(s, 12))
+    recv_exact(s, key_len + val_len)
+    return cmd
+
+
+def wait_for_port(port, timeout=5.0):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        try:
+            socket.create_connection(("localhost", port), timeout=0.2).close()
+            return
+        except OSError:
+            time.sleep(0.05)
+    raise RuntimeError(f"port {port} did not open")
+
+
+def wait_until(fn, timeout=5.0):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        if fn():
+            return True
+        time.sleep(0.05)
+    return False
+
+
+def test_replication(server_bin):
+    primary_dir = tempfile.mkdtemp()
+    replica_dir = tempfile.mkdtemp()
+    procs = []
+    try:
+        procs.append(
+            subprocess.Popen(
+                [server_bin, str(PRIMARY_PORT), "--repl-port", str(REPL_PORT)],
+                cwd=primary_dir,
+                stdout=subprocess.DEVNULL,
+            )
+        )
+        wait_for_port(PRIMARY_PORT)
+
+        # Written before the replica exists: must arrive through the full sync
+        for i in range(50):
+            send_cmd(PRIMARY_PORT, CMD_SET, f"before{i}", f"v{i}")
+
+        procs.append(
+            subprocess.Popen(
+                [server_bin, str(REPLICA_PORT), "--replica-of", f"127.0.0.1:{REPL_PORT}"],
+                cwd=replica_dir,
+                stdout=subprocess.DEVNULL,
+            )
+        )
+        wait_for_port(REPLICA_PORT)
+
+        assert wait_until(lambda: send_cmd(REPLICA_PORT, CMD_GET, "before49") == "v49"), "full sync failed"
+        for i in range(50):
+            assert send_cmd(REPLICA_PORT, CMD_GET, f"before{i}") == f"v{i}"
+        print("Full sync: OK")
+
+        # Written after the sync: must arrive through the command stream
+        send_cmd(PRIMARY_PORT, CMD_SET, "after", "streamed")
+        for _ in range(5):
+            send_cmd(PRIMARY_PORT, CMD_INCR, "counter")
+            send_cmd(PRIMARY_PORT, CMD_APPEND, "log", "x")
+        send_cmd(PRIMARY_PORT, CMD_DEL, "before0")
+        assert wait_until(lambda: send_cmd(REPLICA_PORT, CMD_GET, "after") == "streamed"), "stream failed"
+        assert wait_until(lambda: send_cmd(REPLICA_PORT, CMD_GET, "before0") == ""), "DEL not replicated"
+        assert wait_until(lambda: send_cmd(REPLICA_PORT, CMD_GET, "counter") == "5"), "INCR not replicated"
+        assert send_cmd(REPLICA_PORT, CMD_GET, "log") == "xxxxx"
+        print("Streaming: OK")
+
+        assert send_cmd(REPLICA_PORT, CMD_SET, "x", "y") == "ERR read-only replica"
+        print("Read-only replica: OK")
+
+        stats = send_cmd(REPLICA_PORT, CMD_STATS, "")
+        print(f"Replica stats: {stats}")
+        assert "Role: replica" in stats and "Link: up" in stats
+        stats = send_cmd(PRIMARY_PORT, CMD_STATS, "")
+        print(f"Primary stats: {stats}")
+        assert "Replicas: 1" in stats
+
+        # Sustained writes: the primary's offset and clock must still reach the replica
+        link = socket.create_connection(("localhost", REPL_PORT))
+        link.sendall(encode_msg(CMD_SYNC, ""))
+        while read_frame(link) != CMD_SYNC:
+            pass
+        done = threading.Event()
+
+        def write_load():
+            s = socket.create_connection(("localhost", PRIMARY_PORT))
+            while not done.is_set():
+                s.sendall(b"".join(encode_msg(CMD_SET, f"load{i}", "v") for i in range(100)))
+                for _ in range(100):
+                    recv_exact(s, 12)
+            s.close()
+
+        writer = threading.Thread(target=write_load)
+        writer.start()
+        pings = 0
+        deadline = time.time() + 4
+        try:
+            while time.time() < deadline:
+                pings += read_frame(link) == CMD_PING
+        finally:
+            done.set()
+            writer.join()
+            link.close()
+        assert pings >= 2, pings
+        print(f"Heartbeats under load: {pings} OK")
+
+        print("SUCCESS: Replication works!")
+    finally:
+        for p in procs:
+            p.terminate()
+            p.wait()
+
+
+if __name__ == "__main__":
+    server = sys.argv[1] if len(sys.argv) > 1 else os.path.join("build", "linux", "x86_64", "release", "kv_server")
+    test_replication(os.path.abspath(server))
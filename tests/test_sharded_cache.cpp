@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <set>
+#include <shared_mutex>
 #include <string>
 #include <thread>
 #include <vector>
@@ -30,7 +32,8 @@ TEST(ShardedCacheTest, Distribution) {
 }
 
 TEST(ShardedCacheTest, Concurrency) {
-    ShardedCache<int, int> cache(1000, 16);
+    // Mixed hashing doesn't fill shards evenly, so leave headroom to avoid evictions
+    ShardedCache<int, int> cache(2000, 16);
     std::vector<std::thread> threads;
 
     // 10 threads writing
@@ -47,6 +50,96 @@ TEST(ShardedCacheTest, Concurrency) {
     EXPECT_EQ(cache.size(), 1000);
 }
 
+TEST(ShardedCacheTest, ShardCountRoundsUpToPowerOfTwo) {
+    ShardedCache<int, int> cache(100, 12);
+    EXPECT_EQ(cache.numShards(), 16);
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_LT(cache.shardIndex(i), 16);
+    }
+}
+
+TEST(ShardedCacheTest, MixerSpreadsStridedKeys) {
+    // Keys with a stride of 16: the identity hash routes them all to shard 0
+    ShardedCache<int, int, std::hash<int>, LruEviction, std::mutex, IdentityMixer> identity(1000, 16);
+    ShardedCache<int, int> mixed(1000, 16);
+
+    std::set<size_t> identity_shards, mixed_shards;
+    for (int i = 0; i < 256; ++i) {
+        identity_shards.insert(identity.shardIndex(i * 16));
+        mixed_shards.insert(mixed.shardIndex(i * 16));
+    }
+    EXPECT_EQ(identity_shards.size(), 1);
+    EXPECT_EQ(mixed_shards.size(), 16);
+}
+
+template <typename Cache>
+class ShardedCachePolicyTest : public ::testing::Test {};
+
+using PolicyCombinations =
+    ::testing::Types<ShardedCache<int, int>, ShardedCache<int, int, std::hash<int>, FifoEviction>,
+                     ShardedCache<int, int, std::hash<int>, LruEviction, std::shared_mutex>,
+                     ShardedCache<int, int, std::hash<int>, LruEviction, SpinLock>,
+                     ShardedCache<int, int, std::hash<int>, LruEviction, NullLock, IdentityMixer>>;
+TYPED_TEST_SUITE(ShardedCachePolicyTest, PolicyCombinations);
+
+TYPED_TEST(ShardedCachePolicyTest, PutGetRemove) {
+    TypeParam cache(64, 4);
+    for (int i = 0; i < 32; ++i) {
+        cache.put(i, i * 10);
+    }
+    for (int i = 0; i < 32; ++i) {
+        ASSERT_TRUE(cache.get(i).has_value());
+        EXPECT_EQ(cache.get(i).value(), i * 10);
+    }
+    EXPECT_TRUE(cache.remove(5));
+    EXPECT_FALSE(cache.exists(5));
+    EXPECT_EQ(cache.size(), 31);
+}
+
+TYPED_TEST(ShardedCachePolicyTest, WithShardRunsGroupedOperations) {
+    TypeParam cache(64, 4);
+    cache.put(1, 10);
+    size_t shard = cache.shardIndex(1);
+    std::vector<int> keys;
+    for (int i = 1; keys.size() < 3; ++i) {
+        if (cache.shardIndex(i) == shard) keys.push_back(i);
+    }
+
+    cache.withShard(shard, [&](auto& batch) {
+        for (int key : keys) {
+            batch.prefetch(key);
+        }
+        EXPECT_EQ(batch.get(keys[0]), std::optional<int>(10));
+        batch.update(keys[1], [](const int*, uint64_t) { return std::optional<int>(20); });
+        EXPECT_EQ(batch.get(keys[1]), std::optional<int>(20));
+        EXPECT_TRUE(batch.remove(keys[0], [] {}));
+        EXPECT_FALSE(batch.get(keys[2]).has_value());
+    });
+    EXPECT_FALSE(cache.exists(keys[0]));
+    EXPECT_EQ(cache.get(keys[1]), std::optional<int>(20));
+}
+
+TEST(ShardedCacheTest, WithShardInvalidatesHotCopies) {
+    ShardedCache<int, int> cache(64, 4);
+    HotKeyTracker<int, int>::Options options;
+    options.sample_every = 1;
+    options.window = 16;
+    cache.enableHotKeys(options);
+    cache.put(7, 1);
+    for (int i = 0; i < 64; ++i) {
+        cache.get(7);
+    }
+    ASSERT_EQ(cache.hotKeys()->hotKeys(), std::vector<int>{7});
+
+    // A write in the batch is seen by the next read of the same batch
+    cache.withShard(cache.shardIndex(7), [](auto& batch) {
+        EXPECT_EQ(batch.get(7), std::optional<int>(1));
+        batch.update(7, [](const int*, uint64_t) { return std::optional<int>(2); });
+        EXPECT_EQ(batch.get(7), std::optional<int>(2));
+    });
+    EXPECT_EQ(cache.get(7), std::optional<int>(2));
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sharded_cache.h"
+#include "shm_cache.h"
+
+using namespace kvcache;
+
+using ShmCache =
+    ShardedCache<std::string, std::string, std::hash<std::string>, LruEviction, std::mutex, Murmur3Mixer, ShmShard>;
+
+class ShmCacheTest : public ::testing::Test {
+protected:
+    std::string name_ = "/kvcache_test_" + std::to_string(getpid());
+    ShmRegion::Geometry geometry_{4, 8, 64, 42};
+
+    void SetUp() override { ShmRegion::unlink(name_); }
+    void TearDown() override { ShmRegion::unlink(name_); }
+
+    static ShmCache makeCache(ShmRegion& region) {
+        return ShmCache(region.geometry().num_shards,
+                        [&region](size_t i) { return std::make_unique<ShmShard>(region, i); });
+    }
+};
+
+TEST_F(ShmCacheTest, ReattachKeepsData) {
+    {
+        ShmRegion region(name_, geometry_);
+        EXPECT_FALSE(region.attached());
+        auto cache = makeCache(region);
+        cache.put("a", "1");
+        cache.put("b", "2");
+    }
+
+    ShmRegion region(name_, geometry_);
+    EXPECT_TRUE(region.attached());
+    auto cache = makeCache(region);
+    EXPECT_EQ(cache.size(), 2u);
+    EXPECT_EQ(cache.get("a").value_or(""), "1");
+    EXPECT_EQ(cache.get("b").value_or(""), "2");
+}
+
+TEST_F(ShmCacheTest, GeometryChangeStartsCold) {
+    {
+        ShmRegion region(name_, geometry_);
+        makeCache(region).put("a", "1");
+    }
+
+    auto changed = geometry_;
+    changed.route_fingerprint = 7;
+    ShmRegion region(name_, changed);
+    EXPECT_FALSE(region.attached());
+    EXPECT_EQ(makeCache(region).size(), 0u);
+}
+
+TEST_F(ShmCacheTest, ShardsArePageAligned) {
+    // A shard size that is not a multiple of the page size
+    ShmRegion region(name_, {4, 1000, 60, 0});
+    auto page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    for (size_t i = 0; i < 4; ++i) {
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(region.shard(i)) % page, 0u) << i;
+    }
+}
+
+TEST_F(ShmCacheTest, EvictsLeastRecentlyUsed) {
+    ShmRegion region(name_, {1, 2, 64, 0});
+    ShmShard shard(region, 0);
+    shard.put("1", "a");
+    shard.put("2", "b");
+    shard.get("1");
+    shard.put("3", "c");
+
+    EXPECT_TRUE(shard.exists("1"));
+    EXPECT_FALSE(shard.exists("2"));
+    EXPECT_TRUE(shard.exists("3"));
+    EXPECT_EQ(shard.size(), 2u);
+}
+
+TEST_F(ShmCacheTest, VersionsAndUpdate) {
+    ShmRegion region(name_, geometry_);
+    ShmShard shard(region, 0);
+
+    uint64_t v1 = shard.update("k", [](const std::string*, uint64_t) { return std::optional<std::string>("x"); });
+    uint64_t v2 = shard.update("k", [](const std::string* current, uint64_t) {
+        return std::optional<std::string>(*current + "y");
+    });
+    EXPECT_GT(v2, v1);
+
+    auto val = shard.getVersioned("k");
+    ASSERT_TRUE(val.has_value());
+    EXPECT_EQ(val->first, "xy");
+    EXPECT_EQ(val->second, v2);
+
+    bool called = false;
+    EXPECT_TRUE(shard.remove("k", [&]() { called = true; }));
+    EXPECT_TRUE(called);
+    EXPECT_FALSE(shard.exists("k"));
+}
+
+TEST_F(ShmCacheTest, OversizedEntriesAreNotCached) {
+    ShmRegion region(name_, geometry_);
+    ShmShard shard(region, 0);
+    shard.put("k", "small");
+    shard.put("k", std::string(100, 'x'));
+
+    // The stale small value must not survive an oversized overwrite
+    EXPECT_FALSE(shard.exists("k"));
+    EXPECT_TRUE(shard.fits("k", std::string(63, 'x')));
+    EXPECT_FALSE(shard.fits("k", std::string(64, 'x')));
+}
+
+TEST_F(ShmCacheTest, ShardLockedByDeadProcessIsWiped) {
+    ShmRegion region(name_, geometry_);
+    {
+        ShmShard shard(region, 0);
+        shard.put("k", "v");
+        EXPECT_FALSE(shard.recovered());
+    }
+
+    pid_t child = fork();
+    if (child == 0) {
+        ShmShard shard(region, 0);
+        shard.acquire().release();  // Exits holding the lock
+        _exit(0);
+    }
+    ASSERT_GT(child, 0);
+    waitpid(child, nullptr, 0);
+
+    ShmShard shard(region, 0);
+    EXPECT_TRUE(shard.recovered());
+    EXPECT_FALSE(shard.exists("k"));
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <map>
+#include <string>
+#include <unistd.h>
+
+#include "sharded_cache.h"
+#include "ssd_tier.h"
+
+using namespace kvcache;
+
+class SsdTierTest : public ::testing::Test {
+protected:
+    std::string dir_ = (std::filesystem::temp_directory_path() / ("kvcache_tier_" + std::to_string(getpid()))).string();
+
+    void SetUp() override { std::filesystem::create_directories(dir_); }
+    void TearDown() override { std::filesystem::remove_all(dir_); }
+};
+
+TEST_F(SsdTierTest, EvictedEntriesArePromoted) {
+    TierLog log(dir_ + "/log", 1 << 20);
+    TieredShard shard(2, log);
+    shard.put("1", "a");
+    shard.put("2", "b");
+    shard.put("3", "c");  // Evicts "1" to the tier
+
+    EXPECT_EQ(log.size(), 1u);
+    EXPECT_EQ(shard.size(), 3u);
+    EXPECT_EQ(shard.get("1").value_or(""), "a");
+    EXPECT_EQ(log.stats().hits, 1u);
+
+    // Promoting "1" evicted "2"; no key lives in both places
+    EXPECT_EQ(log.size(), 1u);
+    EXPECT_EQ(shard.get("2").value_or(""), "b");
+    EXPECT_FALSE(shard.get("missing").has_value());
+    EXPECT_EQ(log.stats().misses, 1u);
+}
+
+TEST_F(SsdTierTest, WritesSeeAndReplaceTierEntries) {
+    TierLog log(dir_ + "/log", 1 << 20);
+    TieredShard shard(1, log);
+
+    shard.put("k", "old");
+    shard.put("other", "x");  // "k" is now in the tier
+    shard.put("k", "new");
+    shard.put("other", "y");  // Evicts "k" again
+    EXPECT_EQ(shard.get("k").value_or(""), "new");
+
+    shard.put("counter", "41");
+    shard.put("other", "z");
+    uint64_t version = shard.update("counter", [](const std::string* current, uint64_t) {
+        return std::optional<std::string>(current ? std::to_string(std::stoi(*current) + 1) : "1");
+    });
+    EXPECT_GT(version, 0u);
+    EXPECT_EQ(shard.get("counter").value_or(""), "42");
+
+    shard.put("other", "w");  // "counter" back to the tier
+    bool removed = false;
+    EXPECT_TRUE(shard.remove("counter", [&]() { removed = true; }));
+    EXPECT_TRUE(removed);
+    EXPECT_FALSE(shard.exists("counter"));
+}
+
+TEST_F(SsdTierTest, BlindWritesDoNotReadTheTier) {
+    TierLog log(dir_ + "/log", 1 << 20);
+    TieredShard shard(1, log);
+    shard.put("k", "old");
+    shard.put("other", "x");  // "k" is now in the tier
+
+    bool logged = false;
+    shard.put("k", "new", [&]() { logged = true; });
+    EXPECT_TRUE(logged);
+    EXPECT_EQ(log.stats().hits, 0u);
+    EXPECT_EQ(shard.get("k").value_or(""), "new");
+    EXPECT_EQ(shard.size(), 2u);
+}
+
+TEST_F(SsdTierTest, SnapshotIncludesTier) {
+    TierLog log(dir_ + "/log", 1 << 20);
+    TieredShard shard(2, log);
+    for (int i = 0; i < 10; ++i) {
+        shard.put(std::to_string(i), "v" + std::to_string(i));
+    }
+
+    std::map<std::string, std::string> seen;
+    auto lock = shard.acquire();
+    shard.forEachLocked([&](const std::string& key, const std::string& value) { seen[key] = value; });
+    EXPECT_EQ(seen.size(), 10u);
+    EXPECT_EQ(seen["0"], "v0");
+}
+
+TEST_F(SsdTierTest, SnapshotReadsTierAfterReleasingLocks) {
+    TierLog log(dir_ + "/log", 1 << 20);
+    ShardedCache<std::string, std::string, std::hash<std::string>, LruEviction, std::mutex, Murmur3Mixer, TieredShard>
+        cache(1, [&log](size_t) { return std::make_unique<TieredShard>(2, log); });
+    for (int i = 0; i < 10; ++i) {
+        cache.put(std::to_string(i), "v" + std::to_string(i));
+    }
+
+    bool unlocked = false;
+    size_t after_unlock = 0;
+    std::map<std::string, std::string> seen;
+    cache.snapshot([] {},
+                   [&](const std::string& key, const std::string& value) {
+                       if (unlocked) {
+                           // Would deadlock if the shard were still locked
+                           cache.put(key, "changed");
+                           ++after_unlock;
+                       }
+                       seen[key] = value;
+                   },
+                   [&] { unlocked = true; });
+
+    EXPECT_EQ(after_unlock, 8u);  // Everything but the two entries in memory
+    EXPECT_EQ(seen.size(), 10u);
+    EXPECT_EQ(seen["0"], "v0");  // The value as of the snapshot
+    EXPECT_EQ(cache.get("0").value_or(""), "changed");
+}
+
+TEST_F(SsdTierTest, ReclaimRewritesSparseSegmentsAndEnforcesBudget) {
+    TierLog log(dir_ + "/log", 256);
+    for (int i = 0; i < 100; ++i) {
+        log.put("key" + std::to_string(i), std::string(20, 'x'));
+    }
+    for (int i = 0; i < 100; ++i) {
+        if (i % 10 != 0) log.erase("key" + std::to_string(i));
+    }
+
+    uint64_t before = log.bytes();
+    while (log.reclaim(0.5, UINT64_MAX)) {
+    }
+    EXPECT_LT(log.bytes(), before);
+    EXPECT_EQ(log.size(), 10u);
+    for (int i = 0; i < 100; i += 10) {
+        std::string key = "key" + std::to_string(i);
+        auto loc = log.find(key);
+        ASSERT_TRUE(loc.has_value());
+        EXPECT_EQ(log.read(key, *loc).value_or(""), std::string(20, 'x'));
+    }
+
+    while (log.reclaim(0.5, 0)) {
+    }
+    EXPECT_LT(log.size(), 10u);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,58 @@
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+from test_replication import CMD_DEL, CMD_GET, CMD_SET, CMD_STATS, send_cmd, wait_for_port
+
+PORT = 8093
+NUM_KEYS = 3000  # Three times the server's in-memory capacity
+
+
+def test_ssd_tier(server_bin):
+    workdir = tempfile.mkdtemp()
+    proc = subprocess.Popen(
+        [server_bin, str(PORT), "--ssd-tier", os.path.join(workdir, "tier")], cwd=workdir, stdout=subprocess.DEVNULL
+    )
+    try:
+        wait_for_port(PORT)
+        for i in range(NUM_KEYS):
+            send_cmd(PORT, CMD_SET, f"key{i}", f"value{i}")
+
+        for i in range(NUM_KEYS):
+            assert send_cmd(PORT, CMD_GET, f"key{i}") == f"value{i}", f"key{i} lost"
+        print("Dataset larger than memory: OK")
+
+        # Deletes and overwrites must reach entries living in the tier
+        send_cmd(PORT, CMD_SET, "key0", "rewritten")
+        send_cmd(PORT, CMD_DEL, "key1")
+        for i in range(NUM_KEYS // 2, NUM_KEYS):
+            send_cmd(PORT, CMD_GET, f"key{i}")  # Pushes key0 back out to the tier
+        assert send_cmd(PORT, CMD_GET, "key0") == "rewritten"
+        assert send_cmd(PORT, CMD_GET, "key1") == ""
+        print("Tier invalidation: OK")
+
+        # Overwriting keys that live in the tier does not read them back
+        def tier_hits():
+            return int(re.search(r"Tier-Hits: (\d+)", send_cmd(PORT, CMD_STATS, "")).group(1))
+
+        before = tier_hits()
+        for i in range(2, 200):
+            send_cmd(PORT, CMD_SET, f"key{i}", "blind")
+        assert tier_hits() == before
+        assert send_cmd(PORT, CMD_GET, "key2") == "blind"
+        print("Blind writes skip the tier read: OK")
+
+        stats = send_cmd(PORT, CMD_STATS, "")
+        print(f"Stats: {stats}")
+        assert "Tier-Hits: 0," not in stats and "Tier-Read-Ns" in stats
+        print("SUCCESS: SSD tier works!")
+    finally:
+        proc.terminate()
+        proc.wait()
+
+
+if __name__ == "__main__":
+    server = sys.argv[1] if len(sys.argv) > 1 else os.path.join("build", "linux", "x86_64", "release", "kv_server")
+    test_ssd_tier(os.path.abspath(server))
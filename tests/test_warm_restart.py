@@ -0,0 +1,54 @@
+import os
+import subprocess
+import sys
+import tempfile
+
+from test_replication import CMD_APPEND, CMD_GET, CMD_INCR, CMD_SET, send_cmd, wait_for_port
+
+PORT = 8092
+SEGMENT = f"/kvcache_warm_{os.getpid()}"
+
+
+def start(server_bin, cwd):
+    proc = subprocess.Popen([server_bin, str(PORT), "--shm", SEGMENT], cwd=cwd, stdout=subprocess.DEVNULL)
+    wait_for_port(PORT)
+    return proc
+
+
+def test_warm_restart(server_bin):
+    workdir = tempfile.mkdtemp()
+    proc = start(server_bin, workdir)
+    try:
+        for i in range(100):
+            send_cmd(PORT, CMD_SET, f"key{i}", f"v{i}")
+        for _ in range(3):
+            send_cmd(PORT, CMD_INCR, "counter")
+
+        # Entries larger than a slot are refused rather than acknowledged and dropped
+        assert send_cmd(PORT, CMD_SET, "huge", "x" * 2000) == "ERR value too large"
+        assert send_cmd(PORT, CMD_GET, "huge") == ""
+        send_cmd(PORT, CMD_SET, "big", "x" * 1000)
+        assert send_cmd(PORT, CMD_APPEND, "big", "y" * 100) == "ERR value too large"
+        assert send_cmd(PORT, CMD_GET, "big") == "x" * 1000
+
+        # Crash, and remove the AOF so only the shared-memory segment can restore the data
+        proc.kill()
+        proc.wait()
+        os.remove(os.path.join(workdir, "appendonly.aof"))
+
+        proc = start(server_bin, workdir)
+        for i in range(100):
+            assert send_cmd(PORT, CMD_GET, f"key{i}") == f"v{i}", f"key{i} lost"
+        assert send_cmd(PORT, CMD_GET, "counter") == "3"
+        print("SUCCESS: Warm restart kept the cache!")
+    finally:
+        proc.terminate()
+        proc.wait()
+        shm_path = "/dev/shm" + SEGMENT
+        if os.path.exists(shm_path):
+            os.remove(shm_path)
+
+
+if __name__ == "__main__":
+    server = sys.argv[1] if len(sys.argv) > 1 else os.path.join("build", "linux", "x86_64", "release", "kv_server")
+    test_warm_restart(os.path.abspath(server))
@@ -10,7 +10,9 @@ target("kvcache_lib")
     set_kind("static")
 
     add_includedirs("include")
-    add_files("src/tcp_server.cpp", "src/aof.cpp")
+    add_files("src/tcp_server.cpp", "src/aof.cpp", "src/socket_io.cpp", "src/replication.cpp", "src/proxy.cpp",
+              "src/shm_cache.cpp", "src/ssd_tier.cpp", "src/backend.cpp", "src/numa.cpp")
+    add_syslinks("rt", {public = true})
 
 
 target("kv_server")
@@ -19,6 +21,12 @@ target("kv_server")
     add_includedirs("include")
     add_files("src/main.cpp")
 
+target("kv_proxy")
+    set_kind("binary")
+    add_deps("kvcache_lib")
+    add_includedirs("include")
+    add_files("src/proxy_main.cpp")
+
 target("test_lru_cache")
     set_kind("binary")
     add_packages("gtest")
@@ -33,6 +41,48 @@ target("test_sharded_cache")
     add_files("tests/test_sharded_cache.cpp")
     add_tests("default")
 
+target("test_consistent_hash")
+    set_kind("binary")
+    add_packages("gtest")
+    add_includedirs("include")
+    add_files("tests/test_consistent_hash.cpp")
+    add_tests("default")
+
+target("test_shm_cache")
+    set_kind("binary")
+    add_packages("gtest")
+    add_includedirs("include")
+    add_files("tests/test_shm_cache.cpp", "src/shm_cache.cpp", "src/numa.cpp")
+    add_tests("default")
+
+target("test_ssd_tier")
+    set_kind("binary")
+    add_packages("gtest")
+    add_includedirs("include")
+    add_files("tests/test_ssd_tier.cpp", "src/ssd_tier.cpp")
+    add_tests("default")
+
+target("test_hot_keys")
+    set_kind("binary")
+    add_packages("gtest")
+    add_includedirs("include")
+    add_files("tests/test_hot_keys.cpp")
+    add_tests("default")
+
+target("test_cache_loader")
+    set_kind("binary")
+    add_packages("gtest")
+    add_includedirs("include")
+    add_files("tests/test_cache_loader.cpp")
+    add_tests("default")
+
+target("test_numa")
+    set_kind("binary")
+    add_packages("gtest")
+    add_includedirs("include")
+    add_files("tests/test_numa.cpp", "src/numa.cpp", "src/tcp_server.cpp")
+    add_tests("default")
+
 target("benchmark_cache")
     set_kind("binary")
     add_packages("benchmark")